@@ -0,0 +1,255 @@
+#!/usr/bin/python3
+"""Lifecycle and density benchmarks for my_runner.
+
+Drives the my_runner CLI through scripted scenarios and writes the results
+as JSON, so two builds can be compared on the same machine:
+
+    sudo python3 benchmark.py --output before.json
+    sudo python3 benchmark.py --output after.json
+
+Every container the benchmark creates is stopped and removed at the end.
+"""
+import argparse
+import json
+import os
+import platform
+import re
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+PID_RE = re.compile(r"PID (\d+)")
+STATE_DIR = "/run/my_runtime"
+CGROUP_DIR = "/sys/fs/cgroup/my_runtime"
+
+
+def run_cli(args, *extra):
+    """Runs one my_runner command and returns (seconds, stdout)."""
+    cmd = [args.runner] + list(extra)
+    # A detached container inherits stdout, so a pipe would never reach EOF.
+    with tempfile.TemporaryFile(mode="w+") as out:
+        start = time.perf_counter()
+        proc = subprocess.run(cmd, stdout=out, stderr=subprocess.DEVNULL)
+        elapsed = time.perf_counter() - start
+        out.seek(0)
+        text = out.read()
+    if proc.returncode != 0:
+        raise RuntimeError("command failed: %s" % " ".join(cmd))
+    return elapsed, text
+
+
+def summarize(samples):
+    """Latency summary in milliseconds."""
+    ms = sorted(s * 1000.0 for s in samples)
+    if not ms:
+        return {}
+    return {
+        "count": len(ms),
+        "min_ms": ms[0],
+        "mean_ms": statistics.mean(ms),
+        "p50_ms": ms[len(ms) // 2],
+        "p99_ms": ms[min(len(ms) - 1, int(len(ms) * 0.99))],
+        "max_ms": ms[-1],
+    }
+
+
+def start_detached(args):
+    elapsed, out = run_cli(args, "run", "--detach", args.image, *args.command)
+    match = PID_RE.search(out)
+    if not match:
+        raise RuntimeError("could not parse container PID from: %r" % out)
+    return elapsed, match.group(1)
+
+
+def remove(args, pid):
+    subprocess.run([args.runner, "stop", pid], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    subprocess.run([args.runner, "rm", pid], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+
+def drop_caches():
+    os.sync()
+    with open("/proc/sys/vm/drop_caches", "w") as f:
+        f.write("3")
+
+
+def read_meminfo():
+    values = {}
+    with open("/proc/meminfo") as f:
+        for line in f:
+            key, rest = line.split(":", 1)
+            values[key] = int(rest.split()[0]) * 1024
+    return values
+
+
+def count_mounts():
+    with open("/proc/self/mountinfo") as f:
+        return sum(1 for _ in f)
+
+
+def count_cgroups():
+    if not os.path.isdir(CGROUP_DIR):
+        return 0
+    return sum(1 for e in os.scandir(CGROUP_DIR) if e.is_dir())
+
+
+def check_unique_overlays(pids):
+    """Containers sharing an overlay layer would corrupt each other and the
+    density numbers, so refuse to report them."""
+    owners = {}
+    for pid in pids:
+        with open(os.path.join(STATE_DIR, pid, "overlay_id")) as f:
+            overlay_id = f.read().strip()
+        if overlay_id in owners:
+            raise RuntimeError("containers %s and %s share overlay %s" % (owners[overlay_id], pid, overlay_id))
+        owners[overlay_id] = pid
+
+
+def bench_run(args):
+    """Cold run drops the page cache before every launch; warm does not."""
+    results = {}
+    for mode in ("cold", "warm"):
+        samples = []
+        for _ in range(args.iterations):
+            if mode == "cold":
+                drop_caches()
+            elapsed, pid = start_detached(args)
+            samples.append(elapsed)
+            remove(args, pid)
+        results[mode] = summarize(samples)
+    return results
+
+
+def bench_lifecycle(args):
+    stop, start, restart, rm = [], [], [], []
+    for _ in range(args.iterations):
+        _, pid = start_detached(args)
+        elapsed, _ = run_cli(args, "stop", pid)
+        stop.append(elapsed)
+        elapsed, out = run_cli(args, "start", pid)
+        start.append(elapsed)
+        pid = PID_RE.search(out).group(1)
+        elapsed, out = run_cli(args, "restart", pid)
+        restart.append(elapsed)
+        pid = PID_RE.search(out).group(1)
+        run_cli(args, "stop", pid)
+        elapsed, _ = run_cli(args, "rm", pid)
+        rm.append(elapsed)
+    return {"stop": summarize(stop), "start": summarize(start), "restart": summarize(restart), "rm": summarize(rm)}
+
+
+def bench_throughput(args):
+    results = {}
+    for callers in args.concurrency:
+        total = callers * args.iterations
+        begin = time.perf_counter()
+        with ThreadPoolExecutor(max_workers=callers) as pool:
+            launches = list(pool.map(lambda _: start_detached(args), range(total)))
+        wall = time.perf_counter() - begin
+        pids = [pid for _, pid in launches]
+        results[str(callers)] = {
+            "containers": total,
+            "wall_s": wall,
+            "launches_per_s": total / wall,
+            "latency": summarize([elapsed for elapsed, _ in launches]),
+        }
+        with ThreadPoolExecutor(max_workers=callers) as pool:
+            list(pool.map(lambda pid: remove(args, pid), pids))
+    return results
+
+
+def bench_scale(args):
+    """Grows the container count step by step, timing list/status at each
+    step and recording the kernel memory each container costs."""
+    pids = []
+    steps = []
+    base_mem = read_meminfo()
+    base_mounts = count_mounts()
+    base_cgroups = count_cgroups()
+    try:
+        for target in args.scale:
+            while len(pids) < target:
+                pids.append(start_detached(args)[1])
+            check_unique_overlays(pids)
+            list_samples = [run_cli(args, "list")[0] for _ in range(args.iterations)]
+            status_samples = [run_cli(args, "status", pids[i % len(pids)])[0] for i in range(args.iterations)]
+            mem = read_meminfo()
+            n = len(pids)
+            steps.append({
+                "containers": n,
+                "list": summarize(list_samples),
+                "status": summarize(status_samples),
+                "per_container": {
+                    "slab_bytes": (mem["Slab"] - base_mem["Slab"]) / n,
+                    "slab_unreclaimable_bytes": (mem["SUnreclaim"] - base_mem["SUnreclaim"]) / n,
+                    "kernel_stack_bytes": (mem["KernelStack"] - base_mem["KernelStack"]) / n,
+                    "page_table_bytes": (mem["PageTables"] - base_mem["PageTables"]) / n,
+                    "mounts": (count_mounts() - base_mounts) / n,
+                    "cgroups": (count_cgroups() - base_cgroups) / n,
+                },
+            })
+            print("  %d containers: list p50 %.1f ms" % (n, steps[-1]["list"]["p50_ms"]), file=sys.stderr)
+    finally:
+        with ThreadPoolExecutor(max_workers=max(args.concurrency)) as pool:
+            list(pool.map(lambda pid: remove(args, pid), pids))
+    return steps
+
+
+SCENARIOS = {
+    "run": bench_run,
+    "lifecycle": bench_lifecycle,
+    "throughput": bench_throughput,
+    "scale": bench_scale,
+}
+
+
+def int_list(value):
+    return [int(v) for v in value.split(",") if v]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark my_runner lifecycle operations.")
+    parser.add_argument("--runner", default="./my_runner")
+    parser.add_argument("--image", default="ubuntu-base-image")
+    parser.add_argument("--command", nargs="+", default=["/bin/sleep", "3600"],
+                        help="command run in every container (default: /bin/sleep 3600)")
+    parser.add_argument("--iterations", type=int, default=20)
+    parser.add_argument("--concurrency", type=int_list, default=[1, 4, 16],
+                        help="comma-separated numbers of concurrent callers")
+    parser.add_argument("--scale", type=int_list, default=[10, 100, 1000, 10000],
+                        help="comma-separated container counts for list/status")
+    parser.add_argument("--scenarios", default=",".join(SCENARIOS),
+                        help="comma-separated subset of: " + ", ".join(SCENARIOS))
+    parser.add_argument("--output", help="write JSON here instead of stdout")
+    args = parser.parse_args()
+
+    if os.geteuid() != 0:
+        sys.exit("benchmark.py must run as root, like my_runner itself.")
+    if os.path.isdir(STATE_DIR) and os.listdir(STATE_DIR):
+        print("Warning: existing containers in %s will skew the results." % STATE_DIR, file=sys.stderr)
+
+    report = {
+        "timestamp": time.strftime("%Y-%m-%dT%H:%M:%S%z"),
+        "kernel": platform.release(),
+        "cpus": os.cpu_count(),
+        "runner": args.runner,
+        "image": args.image,
+        "iterations": args.iterations,
+        "results": {},
+    }
+    for name in args.scenarios.split(","):
+        print("--> Running scenario '%s'..." % name, file=sys.stderr)
+        report["results"][name] = SCENARIOS[name](args)
+
+    text = json.dumps(report, indent=2)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text + "\n")
+    else:
+        print(text)
+
+
+if __name__ == "__main__":
+    main()
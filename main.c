@@ -14,12 +14,50 @@
 #include <dirent.h>
 #include <time.h>
 #include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/file.h>
+#include <sys/xattr.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/fanotify.h>
+#include <linux/loop.h>
 
 
 #define STACK_SIZE (1024 * 1024)
 #define MY_RUNTIME_CGROUP "/sys/fs/cgroup/my_runtime"
 #define MY_RUNTIME_STATE "/run/my_runtime"
 #define NEXT_CPU_FILE "/tmp/my_runtime_next_cpu"
+#define MY_RUNTIME_IMAGES "/run/my_runtime_images"
+#define EROFS_SUPER_OFFSET 1024
+#define EROFS_SUPER_MAGIC 0xE0F5E1E2u
+#define DEFAULT_CPU_PERIOD "100000"
+#define DEFAULT_RT_PRIORITY 50
+#define DEFAULT_EPHEMERAL_SIZE "256M"
+#define RECLAIM_MIN_BYTES (1024 * 1024)
+#define API_SOCKET "/run/my_runtime.sock"
+#define API_MAX_FRAME 65536
+#define API_MAX_ARGS 256
+#define MY_RUNTIME_PREFETCH "/var/lib/my_runtime/prefetch"
+#define DEFAULT_PREFETCH_SECONDS 10
+#define PREFETCH_WORKERS 4
+#define MAX_PREFETCH_FILES 4096
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+#ifndef SCHED_FLAG_RESET_ON_FORK
+#define SCHED_FLAG_RESET_ON_FORK 0x01
+#endif
+// Only present on kernels carrying the latency-nice patches.
+#define SCHED_FLAG_LATENCY_NICE 0x80
+#define SCHED_ATTR_SIZE_VER1 56
+#define SCHED_ATTR_SIZE_LATENCY 60
 
 // ---------- Helper functions -----------
 
@@ -37,9 +75,12 @@ void read_file_string(const char *path, char *buf, size_t size) {
     }
 }
 
+void unpin_namespaces(const char *state_dir);
+
 void cleanup_mounts(int pid) {
     char state_dir[PATH_MAX];
     snprintf(state_dir, sizeof(state_dir), "%s/%d", MY_RUNTIME_STATE, pid);
+    unpin_namespaces(state_dir);
     char overlay_id_path[PATH_MAX];
     snprintf(overlay_id_path, sizeof(overlay_id_path), "%s/overlay_id", state_dir);
     int random_id = -1;
@@ -61,24 +102,8 @@ void cleanup_mounts(int pid) {
             }
         }
 
-        
-        char propagate_mount_path[PATH_MAX];
-        snprintf(propagate_mount_path, sizeof(propagate_mount_path), "%s/propagate_mount_dir", state_dir);
-        FILE* p_file = fopen(propagate_mount_path, "r");
-        if (p_file) {
-            char p_dir[PATH_MAX];
-            if (fgets(p_dir, sizeof(p_dir), p_file)) {
-                p_dir[strcspn(p_dir, "\n")] = 0; 
-                char container_mount_point[PATH_MAX];
-                snprintf(container_mount_point, sizeof(container_mount_point), "%s%s", merged, p_dir);
-                if (umount2(container_mount_point, MNT_DETACH) != 0) {
-                    if (errno != ENOENT && errno != EINVAL) {
-                        perror("umount2 propagated mount failed");
-                    }
-                }
-            }
-            fclose(p_file);
-        }
+        // Volumes (including --propagate-mount) are mounted inside the
+        // container's mount namespace and are gone once its last process is.
 
         
         if (umount2(merged, MNT_DETACH) != 0) {
@@ -86,6 +111,15 @@ void cleanup_mounts(int pid) {
                 perror("umount2 overlay failed");
             }
         }
+
+        // Ephemeral containers keep upper/work on a tmpfs; free it on stop.
+        char scratch[PATH_MAX];
+        snprintf(scratch, sizeof(scratch), "overlay_layers/%d/scratch", random_id);
+        if (umount2(scratch, MNT_DETACH) != 0) {
+            if (errno != ENOENT && errno != EINVAL) {
+                perror("umount2 ephemeral layer failed");
+            }
+        }
     }
 }
 
@@ -107,10 +141,200 @@ void setup_cgroup_hierarchy() {
     system("echo \"+cpu +memory +pids +io\" > /sys/fs/cgroup/my_runtime/cgroup.subtree_control 2>/dev/null || true");
 }
 
+// ---------- Volumes -----------
+
+// A volume is given as comma-separated key=value pairs:
+//   type=bind,src=/host/dir,dst=/data[,ro][,propagation=private|shared|slave|unbindable]
+//   type=tmpfs,dst=/scratch[,size=256M][,mode=1777][,ro]
+// or in the short form /host/dir:/data[:ro] for a bind volume. Volumes are
+// mounted inside the container's mount namespace, so they all disappear
+// together with it.
+struct volume {
+    char type[8];
+    char src[PATH_MAX];
+    char dst[PATH_MAX];
+    char size[32];
+    char mode[8];
+    char propagation[16];
+    int read_only;
+};
+
+int parse_volume(const char *spec, struct volume *vol) {
+    char buf[PATH_MAX * 2];
+    memset(vol, 0, sizeof(*vol));
+    snprintf(buf, sizeof(buf), "%s", spec);
+
+    if (strchr(buf, '=') == NULL) {
+        char *dst = strchr(buf, ':');
+        if (dst == NULL) {
+            fprintf(stderr, "Invalid volume '%s': expected <src>:<dst>[:ro] or key=value pairs\n", spec);
+            return -1;
+        }
+        *dst++ = '\0';
+        char *flags = strchr(dst, ':');
+        if (flags) {
+            *flags++ = '\0';
+            vol->read_only = strcmp(flags, "ro") == 0;
+        }
+        snprintf(vol->type, sizeof(vol->type), "bind");
+        snprintf(vol->src, sizeof(vol->src), "%s", buf);
+        snprintf(vol->dst, sizeof(vol->dst), "%s", dst);
+    } else {
+        char *save = NULL;
+        for (char *item = strtok_r(buf, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+            char *value = strchr(item, '=');
+            if (value) *value++ = '\0';
+            if (strcmp(item, "ro") == 0) vol->read_only = 1;
+            else if (strcmp(item, "rw") == 0) vol->read_only = 0;
+            else if (value && strcmp(item, "type") == 0) snprintf(vol->type, sizeof(vol->type), "%s", value);
+            else if (value && strcmp(item, "src") == 0) snprintf(vol->src, sizeof(vol->src), "%s", value);
+            else if (value && strcmp(item, "dst") == 0) snprintf(vol->dst, sizeof(vol->dst), "%s", value);
+            else if (value && strcmp(item, "size") == 0) snprintf(vol->size, sizeof(vol->size), "%s", value);
+            else if (value && strcmp(item, "mode") == 0) snprintf(vol->mode, sizeof(vol->mode), "%s", value);
+            else if (value && strcmp(item, "propagation") == 0) snprintf(vol->propagation, sizeof(vol->propagation), "%s", value);
+            else {
+                fprintf(stderr, "Invalid volume '%s': unknown option '%s'\n", spec, item);
+                return -1;
+            }
+        }
+    }
+
+    if (strcmp(vol->type, "bind") != 0 && strcmp(vol->type, "tmpfs") != 0) {
+        fprintf(stderr, "Invalid volume '%s': type must be bind or tmpfs\n", spec);
+        return -1;
+    }
+    if (vol->dst[0] != '/') {
+        fprintf(stderr, "Invalid volume '%s': dst must be an absolute path\n", spec);
+        return -1;
+    }
+    if (strcmp(vol->type, "bind") == 0 && vol->src[0] == '\0') {
+        fprintf(stderr, "Invalid volume '%s': bind volumes need src\n", spec);
+        return -1;
+    }
+    if (vol->propagation[0] != '\0' && strcmp(vol->propagation, "private") != 0 &&
+        strcmp(vol->propagation, "shared") != 0 && strcmp(vol->propagation, "slave") != 0 &&
+        strcmp(vol->propagation, "unbindable") != 0) {
+        fprintf(stderr, "Invalid volume '%s': unknown propagation '%s'\n", spec, vol->propagation);
+        return -1;
+    }
+    return 0;
+}
+
+// Reads the "volumes" state file, one spec per line.
+int load_volumes(const char *state_dir, struct volume *volumes, int max_volumes) {
+    char path_buffer[PATH_MAX], line[PATH_MAX * 2];
+    snprintf(path_buffer, sizeof(path_buffer), "%s/volumes", state_dir);
+    FILE *f = fopen(path_buffer, "r");
+    if (!f) return 0;
+    int count = 0;
+    while (count < max_volumes && fgets(line, sizeof(line), f) != NULL) {
+        line[strcspn(line, "\n")] = 0;
+        if (line[0] != '\0' && parse_volume(line, &volumes[count]) == 0) count++;
+    }
+    fclose(f);
+    return count;
+}
+
+void save_volumes(const char *state_dir, char **specs, int count) {
+    if (count == 0) return;
+    char path_buffer[PATH_MAX];
+    snprintf(path_buffer, sizeof(path_buffer), "%s/volumes", state_dir);
+    FILE *f = fopen(path_buffer, "w");
+    if (!f) { perror("Failed to save volumes"); return; }
+    for (int i = 0; i < count; i++) fprintf(f, "%s\n", specs[i]);
+    fclose(f);
+}
+
+// mkdir -p, or an empty file as the last component when binding a file.
+int make_mount_point(const char *path, int is_file) {
+    char buf[PATH_MAX];
+    snprintf(buf, sizeof(buf), "%s", path);
+    for (char *p = buf + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(buf, 0755) != 0 && errno != EEXIST) return -1;
+        *p = '/';
+    }
+    if (is_file) {
+        int fd = open(buf, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) return -1;
+        close(fd);
+        return 0;
+    }
+    return (mkdir(buf, 0755) != 0 && errno != EEXIST) ? -1 : 0;
+}
+
+// Sets up one volume below root with the new mount API: the mount is built
+// detached (open_tree or fsopen/fsmount), made read-only while nobody can
+// see it yet, and attached atomically with move_mount.
+int mount_volume(const char *root, const struct volume *vol) {
+    char target[PATH_MAX];
+    snprintf(target, sizeof(target), "%s%s", root, vol->dst);
+    unsigned int attr_flags = vol->read_only ? MOUNT_ATTR_RDONLY : 0;
+    int mnt_fd;
+
+    if (strcmp(vol->type, "bind") == 0) {
+        struct stat st;
+        if (stat(vol->src, &st) != 0) { perror("volume source"); return -1; }
+        if (make_mount_point(target, !S_ISDIR(st.st_mode)) != 0) { perror("volume mount point"); return -1; }
+        mnt_fd = open_tree(AT_FDCWD, vol->src, OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC | AT_RECURSIVE);
+        if (mnt_fd < 0) { perror("open_tree failed"); return -1; }
+        if (attr_flags) {
+            struct mount_attr attr = { .attr_set = attr_flags };
+            if (mount_setattr(mnt_fd, "", AT_EMPTY_PATH | AT_RECURSIVE, &attr, sizeof(attr)) != 0) {
+                perror("mount_setattr failed");
+                close(mnt_fd);
+                return -1;
+            }
+        }
+    } else {
+        if (make_mount_point(target, 0) != 0) { perror("volume mount point"); return -1; }
+        int fs_fd = fsopen("tmpfs", FSOPEN_CLOEXEC);
+        if (fs_fd < 0) { perror("fsopen tmpfs failed"); return -1; }
+        if ((vol->size[0] && fsconfig(fs_fd, FSCONFIG_SET_STRING, "size", vol->size, 0) != 0) ||
+            fsconfig(fs_fd, FSCONFIG_SET_STRING, "mode", vol->mode[0] ? vol->mode : "1777", 0) != 0 ||
+            fsconfig(fs_fd, FSCONFIG_CMD_CREATE, NULL, NULL, 0) != 0) {
+            perror("tmpfs volume configuration failed");
+            close(fs_fd);
+            return -1;
+        }
+        mnt_fd = fsmount(fs_fd, FSMOUNT_CLOEXEC, attr_flags | MOUNT_ATTR_NOSUID | MOUNT_ATTR_NODEV);
+        close(fs_fd);
+        if (mnt_fd < 0) { perror("fsmount failed"); return -1; }
+    }
+
+    if (move_mount(mnt_fd, "", AT_FDCWD, target, MOVE_MOUNT_F_EMPTY_PATH) != 0) {
+        perror("move_mount failed");
+        close(mnt_fd);
+        return -1;
+    }
+    close(mnt_fd);
+
+    if (vol->propagation[0] != '\0') {
+        struct mount_attr attr = { 0 };
+        if (strcmp(vol->propagation, "private") == 0) attr.propagation = MS_PRIVATE;
+        else if (strcmp(vol->propagation, "shared") == 0) attr.propagation = MS_SHARED;
+        else if (strcmp(vol->propagation, "slave") == 0) attr.propagation = MS_SLAVE;
+        else attr.propagation = MS_UNBINDABLE;
+        if (mount_setattr(AT_FDCWD, target, AT_RECURSIVE, &attr, sizeof(attr)) != 0) {
+            perror("volume propagation failed");
+        }
+    }
+    return 0;
+}
+
+
+#define MAX_VOLUMES 16
+
+// When set, the container's stdin/stdout/stderr are pointed here instead of
+// being inherited (used by the API server's workers).
+int container_stdio_fd = -1;
+
 struct container_args {
     char* merged_path;
     char** argv;
-    char* propagate_mount_dir;
+    struct volume* volumes;
+    int num_volumes;
     int sync_pipe_read_fd;
 };
 
@@ -123,24 +347,21 @@ int container_main(void *arg) {
     }
     close(args->sync_pipe_read_fd);
 
+    if (container_stdio_fd >= 0) {
+        dup2(container_stdio_fd, STDIN_FILENO);
+        dup2(container_stdio_fd, STDOUT_FILENO);
+        dup2(container_stdio_fd, STDERR_FILENO);
+    }
 
     if (system("ip link set lo up") != 0) {
         perror("Failed to set lo up");
     }
 
-    if (args->propagate_mount_dir) {
-        char container_mount_path[PATH_MAX];
-        char command[PATH_MAX * 2];
-
-        snprintf(container_mount_path, sizeof(container_mount_path), "%s%s", args->merged_path, args->propagate_mount_dir);
-
-        snprintf(command, sizeof(command), "mkdir -p %s", container_mount_path);
-        if (system(command) != 0) {
-            perror("mkdir -p for propagated mount failed");
-        }
-
-        if (mount(args->propagate_mount_dir, container_mount_path, NULL, MS_BIND, NULL) != 0) {
-            perror("bind mount for propagation failed");
+    // A missing volume would silently send its writes into the overlay.
+    for (int i = 0; i < args->num_volumes; i++) {
+        if (mount_volume(args->merged_path, &args->volumes[i]) != 0) {
+            fprintf(stderr, "Failed to mount volume at %s; not starting the command.\n", args->volumes[i].dst);
+            return 1;
         }
     }
 
@@ -198,661 +419,3220 @@ long find_cgroup_value(const char* path, const char* key) {
 }
 
 
-// ---------- CLI commands -----------
-
-int do_run(int argc, char *argv[]) {
-    setup_cgroup_hierarchy();
-    char *mem_limit = NULL;
-    char *cpu_quota = NULL;
-    char *io_read_bps = NULL;
-    char *io_write_bps = NULL;
-    char *propagate_mount_dir = NULL;
-    int pin_cpu_flag = 0;
-    int detach_flag = 0;
-    int share_ipc_flag = 0;
-    char pid_str[16];
+// Reads a cgroup file through an open cgroup directory.
+FILE *open_cgroup_file_at(int cgroup_fd, const char *name) {
+    int fd = openat(cgroup_fd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    FILE *f = fdopen(fd, "r");
+    if (!f) close(fd);
+    return f;
+}
 
-    static struct option long_options[] = {
-            {"mem", required_argument, 0, 'm'},
-            {"cpu", required_argument, 0, 'C'},
-            {"io-read-bps", required_argument, 0, 'r'},
-            {"io-write-bps", required_argument, 0, 'w'},
-            {"pin-cpu", no_argument, NULL, 'p'},
-            {"detach", no_argument, NULL, 'd'},
-            {"share-ipc", no_argument, NULL, 'i'},
-            {"propagate-mount", required_argument, 0, 'M'},
-            {0, 0, 0, 0}
-    };
-    int opt;
-    while ((opt = getopt_long(argc, argv, "+m:C:r:w:pdiM:", long_options, NULL)) != -1) {
-        switch (opt) {
-            case 'm': mem_limit = optarg; break;
-            case 'C': cpu_quota = optarg; break;
-            case 'r': io_read_bps = optarg; break;
-            case 'w': io_write_bps = optarg; break;
-            case 'p': pin_cpu_flag = 1; break;
-            case 'd': detach_flag = 1; break;
-            case 'i': share_ipc_flag = 1; break;
-            case 'M': propagate_mount_dir = optarg; break;
-            default: return 1;
+// One line of machine-readable usage for a container. cgroup_fd may be an
+// already open cgroup directory, or -1 to open it here.
+void print_container_stats(FILE *out, const char *pid_str, int cgroup_fd) {
+    int own_fd = -1;
+    if (cgroup_fd < 0) {
+        char cgroup_path[PATH_MAX];
+        snprintf(cgroup_path, sizeof(cgroup_path), "%s/container_%s", MY_RUNTIME_CGROUP, pid_str);
+        cgroup_fd = own_fd = open(cgroup_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    long mem_current = -1, cpu_usec = -1, pids_current = -1;
+    if (cgroup_fd >= 0) {
+        FILE *f;
+        if ((f = open_cgroup_file_at(cgroup_fd, "memory.current"))) { fscanf(f, "%ld", &mem_current); fclose(f); }
+        if ((f = open_cgroup_file_at(cgroup_fd, "pids.current"))) { fscanf(f, "%ld", &pids_current); fclose(f); }
+        if ((f = open_cgroup_file_at(cgroup_fd, "cpu.stat"))) {
+            char key[64];
+            long value;
+            while (fscanf(f, "%63s %ld", key, &value) == 2) {
+                if (strcmp(key, "usage_usec") == 0) { cpu_usec = value; break; }
+            }
+            fclose(f);
         }
     }
-    if (optind + 1 >= argc) { fprintf(stderr, "Usage: %s run [opts] <image> <cmd>...\n", argv[0]); return 1; }
-    char* image_name = argv[optind];
-    char** container_cmd_argv = &argv[optind + 1];
+    if (own_fd >= 0) close(own_fd);
+    fprintf(out, "%-15s\t%-15ld\t%-15ld\t%ld\n", pid_str, mem_current, cpu_usec, pids_current);
+}
 
-    if (propagate_mount_dir) {
-        if (mount(NULL, propagate_mount_dir, NULL, MS_REC | MS_SHARED, NULL) != 0) {
-            perror("Failed to set mount propagation to SHARED");
-            fprintf(stderr, "Hint: Make sure the directory '%s' exists and is a mount point.\n", propagate_mount_dir);
-            return 1;
+
+// ---------- Scheduling -----------
+
+// Every field is kept as the string that was given on the command line, so
+// it can be written to the state directory verbatim and re-applied by start.
+struct sched_config {
+    char cpu_period[32];
+    char cpu_burst[32];
+    char cpu_weight[32];
+    char cpu_idle[32];
+    char uclamp_min[32];
+    char uclamp_max[32];
+    char policy[32];
+    char priority[32];
+    char dl_runtime[32];
+    char dl_deadline[32];
+    char dl_period[32];
+    char latency_nice[32];
+};
+
+static const struct {
+    const char *state_file;
+    size_t offset;
+} sched_config_fields[] = {
+    { "cpu_period", offsetof(struct sched_config, cpu_period) },
+    { "cpu_burst", offsetof(struct sched_config, cpu_burst) },
+    { "cpu_weight", offsetof(struct sched_config, cpu_weight) },
+    { "cpu_idle", offsetof(struct sched_config, cpu_idle) },
+    { "uclamp_min", offsetof(struct sched_config, uclamp_min) },
+    { "uclamp_max", offsetof(struct sched_config, uclamp_max) },
+    { "sched_policy", offsetof(struct sched_config, policy) },
+    { "sched_priority", offsetof(struct sched_config, priority) },
+    { "sched_runtime", offsetof(struct sched_config, dl_runtime) },
+    { "sched_deadline", offsetof(struct sched_config, dl_deadline) },
+    { "sched_period", offsetof(struct sched_config, dl_period) },
+    { "latency_nice", offsetof(struct sched_config, latency_nice) },
+};
+
+#define SCHED_CONFIG_FIELD_COUNT (sizeof(sched_config_fields) / sizeof(sched_config_fields[0]))
+
+// Layout of the kernel's struct sched_attr; glibc has no sched_setattr wrapper.
+struct runner_sched_attr {
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;
+    uint64_t sched_deadline;
+    uint64_t sched_period;
+    uint32_t sched_util_min;
+    uint32_t sched_util_max;
+    int32_t sched_latency_nice;
+};
+
+int sched_policy_from_name(const char *name) {
+    if (strcmp(name, "other") == 0 || strcmp(name, "normal") == 0) return SCHED_OTHER;
+    if (strcmp(name, "batch") == 0) return SCHED_BATCH;
+    if (strcmp(name, "idle") == 0) return SCHED_IDLE;
+    if (strcmp(name, "fifo") == 0) return SCHED_FIFO;
+    if (strcmp(name, "rr") == 0) return SCHED_RR;
+    if (strcmp(name, "deadline") == 0) return SCHED_DEADLINE;
+    return -1;
+}
+
+void set_sched_field(char *field, const char *value) {
+    snprintf(field, 32, "%s", value);
+}
+
+int parse_sched_number(const char *name, const char *value, long min, long max, long *out) {
+    char *end;
+    errno = 0;
+    long number = strtol(value, &end, 10);
+    if (errno != 0 || end == value || *end != '\0' || number < min || number > max) {
+        fprintf(stderr, "Invalid --%s '%s' (expected %ld..%ld)\n", name, value, min, max);
+        return -1;
+    }
+    *out = number;
+    return 0;
+}
+
+// Rejects settings the kernel would refuse, before anything is created, so a
+// container never silently ends up with the default policy.
+int validate_sched_config(const struct sched_config *cfg, int pin_cpu_flag) {
+    long value, runtime = 0, deadline = 0, period = 0;
+    if (cfg->cpu_weight[0] != '\0' && parse_sched_number("cpu-weight", cfg->cpu_weight, 1, 10000, &value) != 0) return -1;
+    if (cfg->priority[0] != '\0' && parse_sched_number("sched-priority", cfg->priority, 1, 99, &value) != 0) return -1;
+    if (cfg->latency_nice[0] != '\0' && parse_sched_number("latency-nice", cfg->latency_nice, -20, 19, &value) != 0) return -1;
+    if (cfg->dl_runtime[0] != '\0' && parse_sched_number("sched-runtime", cfg->dl_runtime, 1, LONG_MAX / 1000, &runtime) != 0) return -1;
+    if (cfg->dl_deadline[0] != '\0' && parse_sched_number("sched-deadline", cfg->dl_deadline, 1, LONG_MAX / 1000, &deadline) != 0) return -1;
+    if (cfg->dl_period[0] != '\0' && parse_sched_number("sched-period", cfg->dl_period, 1, LONG_MAX / 1000, &period) != 0) return -1;
+
+    if (strcmp(cfg->policy, "deadline") == 0) {
+        if (deadline == 0) deadline = period;
+        if (period == 0) period = deadline;
+        if (runtime == 0 || deadline == 0) {
+            fprintf(stderr, "--sched-policy deadline requires --sched-runtime and --sched-deadline or --sched-period\n");
+            return -1;
+        }
+        if (runtime > deadline || deadline > period) {
+            fprintf(stderr, "--sched-policy deadline requires runtime <= deadline <= period\n");
+            return -1;
+        }
+        // Deadline admission control refuses tasks whose affinity is narrower
+        // than their root domain, so sched_setattr() would always fail.
+        if (pin_cpu_flag) {
+            fprintf(stderr, "--sched-policy deadline cannot be combined with --pin-cpu\n");
+            return -1;
         }
+    } else if (runtime != 0 || deadline != 0 || period != 0) {
+        fprintf(stderr, "--sched-runtime, --sched-deadline and --sched-period need --sched-policy deadline\n");
+        return -1;
     }
+    // --pin-cpu without a policy means rr, see apply_sched_policy().
+    int real_time = strcmp(cfg->policy, "fifo") == 0 || strcmp(cfg->policy, "rr") == 0 ||
+                    (cfg->policy[0] == '\0' && pin_cpu_flag);
+    if (cfg->priority[0] != '\0' && !real_time) {
+        fprintf(stderr, "--sched-priority needs --sched-policy fifo or rr\n");
+        return -1;
+    }
+    return 0;
+}
 
-    char lowerdir[PATH_MAX], upperdir[PATH_MAX], workdir[PATH_MAX], merged[PATH_MAX];
-    srand(time(NULL) ^ getpid());
-    int random_id = rand() % 10000;
-    snprintf(lowerdir, sizeof(lowerdir), "%s", image_name);
-    snprintf(upperdir, sizeof(upperdir), "overlay_layers/%d/upper", random_id);
-    snprintf(workdir, sizeof(workdir), "overlay_layers/%d/work", random_id);
-    snprintf(merged, sizeof(merged), "overlay_layers/%d/merged", random_id);
-    char command[PATH_MAX * 2];
-    sprintf(command, "mkdir -p %s %s %s", upperdir, workdir, merged);
-    if (system(command) != 0) { return 1; }
-
-    char mount_opts[PATH_MAX * 3];
-    snprintf(mount_opts, sizeof(mount_opts), "lowerdir=%s,upperdir=%s,workdir=%s", lowerdir, upperdir, workdir);
-    if (mount("overlay", merged, "overlay", 0, mount_opts) != 0) { perror("Overlay mount failed"); return 1; }
+void save_sched_config(const char *state_dir, const struct sched_config *cfg) {
+    char path_buffer[PATH_MAX];
+    for (size_t i = 0; i < SCHED_CONFIG_FIELD_COUNT; i++) {
+        const char *value = (const char *)cfg + sched_config_fields[i].offset;
+        if (value[0] == '\0') continue;
+        snprintf(path_buffer, sizeof(path_buffer), "%s/%s", state_dir, sched_config_fields[i].state_file);
+        write_file(path_buffer, value);
+    }
+}
 
-    int sync_pipe[2];
-    if (pipe(sync_pipe) == -1) {
-        perror("pipe");
-        return 1;
+void load_sched_config(const char *state_dir, struct sched_config *cfg) {
+    char path_buffer[PATH_MAX];
+    for (size_t i = 0; i < SCHED_CONFIG_FIELD_COUNT; i++) {
+        char *value = (char *)cfg + sched_config_fields[i].offset;
+        snprintf(path_buffer, sizeof(path_buffer), "%s/%s", state_dir, sched_config_fields[i].state_file);
+        read_file_string(path_buffer, value, 32);
     }
+}
 
-    struct container_args args;
-    args.merged_path = merged;
-    args.argv = container_cmd_argv;
-    args.propagate_mount_dir = propagate_mount_dir;
-    args.sync_pipe_read_fd = sync_pipe[0]; 
+// Writes the cpu controller knobs. Everything placed in the cgroup, including
+// threads and children created later, is covered by these.
+void apply_cpu_cgroup(const char *cgroup_path, const char *cpu_quota, const struct sched_config *cfg) {
+    char path_buffer[PATH_MAX];
+    int has_quota = cpu_quota && cpu_quota[0] != '\0';
+    if (has_quota || cfg->cpu_period[0] != '\0') {
+        char cpu_content[64];
+        snprintf(path_buffer, sizeof(path_buffer), "%s/cpu.max", cgroup_path);
+        snprintf(cpu_content, sizeof(cpu_content), "%s %s", has_quota ? cpu_quota : "max",
+                 cfg->cpu_period[0] != '\0' ? cfg->cpu_period : DEFAULT_CPU_PERIOD);
+        write_file(path_buffer, cpu_content);
+    }
+    if (cfg->cpu_burst[0] != '\0') {
+        snprintf(path_buffer, sizeof(path_buffer), "%s/cpu.max.burst", cgroup_path);
+        write_file(path_buffer, cfg->cpu_burst);
+    }
+    if (cfg->cpu_weight[0] != '\0') {
+        snprintf(path_buffer, sizeof(path_buffer), "%s/cpu.weight", cgroup_path);
+        write_file(path_buffer, cfg->cpu_weight);
+    }
+    if (cfg->cpu_idle[0] != '\0') {
+        snprintf(path_buffer, sizeof(path_buffer), "%s/cpu.idle", cgroup_path);
+        write_file(path_buffer, cfg->cpu_idle);
+    }
+    if (cfg->uclamp_min[0] != '\0') {
+        snprintf(path_buffer, sizeof(path_buffer), "%s/cpu.uclamp.min", cgroup_path);
+        write_file(path_buffer, cfg->uclamp_min);
+    }
+    if (cfg->uclamp_max[0] != '\0') {
+        snprintf(path_buffer, sizeof(path_buffer), "%s/cpu.uclamp.max", cgroup_path);
+        write_file(path_buffer, cfg->uclamp_max);
+    }
+}
 
-    char *container_stack = malloc(STACK_SIZE);
-    char *stack_top = container_stack + STACK_SIZE;
+// Sets the scheduling class of the container init. This must run while the
+// init is still blocked on the sync pipe: the policy then survives execv and
+// is inherited by every process and thread the workload creates.
+// --pin-cpu without an explicit policy keeps the historical SCHED_RR/50.
+int apply_sched_policy(pid_t pid, const struct sched_config *cfg, int pin_cpu_flag) {
+    const char *policy_name = cfg->policy;
+    if (policy_name[0] == '\0') {
+        if (pin_cpu_flag) {
+            policy_name = "rr";
+        } else if (cfg->latency_nice[0] != '\0') {
+            policy_name = "other";
+        } else {
+            return 0;
+        }
+    }
+    int policy = sched_policy_from_name(policy_name);
+    if (policy < 0) {
+        fprintf(stderr, "ERROR: Unknown scheduling policy '%s'\n", policy_name);
+        return -1;
+    }
 
-    int clone_flags = CLONE_NEWPID | CLONE_NEWNS | CLONE_NEWUTS | CLONE_NEWUSER | CLONE_NEWNET | SIGCHLD;
-    if (!share_ipc_flag) {
-        clone_flags |= CLONE_NEWIPC;
+    struct runner_sched_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = SCHED_ATTR_SIZE_VER1;
+    attr.sched_policy = policy;
+
+    if (policy == SCHED_FIFO || policy == SCHED_RR) {
+        attr.sched_priority = cfg->priority[0] != '\0' ? atoi(cfg->priority) : DEFAULT_RT_PRIORITY;
+    } else if (policy == SCHED_DEADLINE) {
+        // CLI values are in microseconds like cpu.max; the kernel wants ns.
+        // A deadline task may not fork, so children fall back to SCHED_OTHER
+        // and only the init carries the reservation.
+        unsigned long long deadline = strtoull(cfg->dl_deadline, NULL, 10);
+        unsigned long long period = strtoull(cfg->dl_period, NULL, 10);
+        if (deadline == 0) deadline = period;
+        if (period == 0) period = deadline;
+        attr.sched_runtime = strtoull(cfg->dl_runtime, NULL, 10) * 1000ULL;
+        attr.sched_deadline = deadline * 1000ULL;
+        attr.sched_period = period * 1000ULL;
+        attr.sched_flags |= SCHED_FLAG_RESET_ON_FORK;
+        if (attr.sched_runtime == 0 || attr.sched_deadline == 0) {
+            fprintf(stderr, "ERROR: SCHED_DEADLINE requires --sched-runtime and --sched-deadline or --sched-period\n");
+            return -1;
+        }
+    } else if (cfg->latency_nice[0] != '\0') {
+        attr.size = SCHED_ATTR_SIZE_LATENCY;
+        attr.sched_flags |= SCHED_FLAG_LATENCY_NICE;
+        attr.sched_latency_nice = atoi(cfg->latency_nice);
     }
-    pid_t container_pid = clone(container_main, stack_top, clone_flags, &args);
-    if (container_pid == -1) {
-        perror("clone");
-        free(container_stack);
-        close(sync_pipe[0]);
-        close(sync_pipe[1]);
-        return 1;
+
+    if (syscall(SYS_sched_setattr, pid, &attr, 0) != 0) {
+        if ((attr.sched_flags & SCHED_FLAG_LATENCY_NICE) && (errno == E2BIG || errno == EINVAL)) {
+            fprintf(stderr, "Warning: latency-nice is not supported by this kernel, ignoring it.\n");
+            attr.size = SCHED_ATTR_SIZE_VER1;
+            attr.sched_flags &= ~(uint64_t)SCHED_FLAG_LATENCY_NICE;
+            attr.sched_latency_nice = 0;
+            if (syscall(SYS_sched_setattr, pid, &attr, 0) == 0) return 0;
+        }
+        perror("sched_setattr failed");
+        return -1;
     }
+    return 0;
+}
 
-    close(sync_pipe[0]);
-    
-    char path_buffer[PATH_MAX];
-    uid_t host_uid = getuid();
-    gid_t host_gid = getgid();
+void pin_to_next_cpu(pid_t pid) {
+    FILE *f = fopen(NEXT_CPU_FILE, "r+");
+    int next_cpu = 0;
+    if (f) { fscanf(f, "%d", &next_cpu); }
+    else { f = fopen(NEXT_CPU_FILE, "w"); }
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int target_cpu = next_cpu % num_cpus;
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(target_cpu, &cpuset);
+    if (sched_setaffinity(pid, sizeof(cpu_set_t), &cpuset) != 0) {
+        perror("sched_setaffinity failed");
+    }
+    if (f) {
+        fseek(f, 0, SEEK_SET);
+        fprintf(f, "%ld", (next_cpu + 1) % num_cpus);
+        fclose(f);
+    }
+}
 
-    snprintf(path_buffer, sizeof(path_buffer), "/proc/%d/setgroups", container_pid);
-    write_file(path_buffer, "deny");
 
-    snprintf(path_buffer, sizeof(path_buffer), "/proc/%d/gid_map", container_pid);
-    char map_buffer[100];
-    snprintf(map_buffer, sizeof(map_buffer), "0 %d 1", host_gid);
-    write_file(path_buffer, map_buffer);
+// ---------- Images -----------
 
-    snprintf(path_buffer, sizeof(path_buffer), "/proc/%d/uid_map", container_pid);
-    snprintf(map_buffer, sizeof(map_buffer), "0 %d 1", host_uid);
-    write_file(path_buffer, map_buffer);
+// A single-file EROFS or squashfs image is loop-mounted read-only once under
+// MY_RUNTIME_IMAGES and shared as the overlay lowerdir by every container
+// created from it. The refcount counts containers (running or stopped), so
+// the mount goes away when the last one is removed.
 
-    
-    if (write(sync_pipe[1], "1", 1) != 1) {
-        perror("write to sync pipe");
+int is_image_file(const char *image_name) {
+    struct stat st;
+    return stat(image_name, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+const char *detect_image_fs_type(const char *image_file) {
+    int fd = open(image_file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    unsigned char magic[4];
+    const char *fs_type = NULL;
+    if (pread(fd, magic, sizeof(magic), 0) == sizeof(magic) && memcmp(magic, "hsqs", 4) == 0) {
+        fs_type = "squashfs";
+    } else if (pread(fd, magic, sizeof(magic), EROFS_SUPER_OFFSET) == sizeof(magic)) {
+        uint32_t value = magic[0] | (magic[1] << 8) | (magic[2] << 16) | ((uint32_t)magic[3] << 24);
+        if (value == EROFS_SUPER_MAGIC) fs_type = "erofs";
     }
-    close(sync_pipe[1]); 
+    close(fd);
+    return fs_type;
+}
 
+// Keys the shared mount by the image's absolute path, so relative and
+// absolute spellings of the same file share one mount.
+int image_key(const char *image_file, char *key, size_t size) {
+    char real[PATH_MAX];
+    if (realpath(image_file, real) == NULL) return -1;
+    uint32_t hash = 2166136261u;
+    for (const char *c = real; *c; c++) {
+        hash ^= (unsigned char)*c;
+        hash *= 16777619u;
+    }
+    const char *base = strrchr(real, '/');
+    snprintf(key, size, "%s-%08x", base ? base + 1 : real, hash);
+    return 0;
+}
 
-    char state_dir[PATH_MAX]; snprintf(state_dir, sizeof(state_dir), "%s/%d", MY_RUNTIME_STATE, container_pid); mkdir(state_dir, 0755);
-    char cgroup_path[PATH_MAX]; snprintf(cgroup_path, sizeof(cgroup_path), "%s/container_%d", MY_RUNTIME_CGROUP, container_pid);
-    if(mkdir(cgroup_path, 0755) != 0 && errno != EEXIST) { perror("Failed to create container cgroup"); }
+int is_mount_point(const char *path) {
+    char parent[PATH_MAX];
+    struct stat st, parent_st;
+    snprintf(parent, sizeof(parent), "%s/..", path);
+    if (stat(path, &st) != 0 || stat(parent, &parent_st) != 0) return 0;
+    return st.st_dev != parent_st.st_dev;
+}
 
-    snprintf(path_buffer, sizeof(path_buffer), "%s/command", state_dir);
-    FILE *cmd_file = fopen(path_buffer, "w");
-    if (cmd_file) {
-        for (int i = 0; container_cmd_argv[i] != NULL; i++) { fprintf(cmd_file, "%s ", container_cmd_argv[i]); }
-        fclose(cmd_file);
+// Binds the image to a free loop device and returns an open fd of it. The
+// caller keeps that fd until the device is mounted: with AUTOCLEAR the
+// kernel detaches the device on the last close, mounts included.
+int attach_loop_device(const char *image_file, char *loop_path, size_t size) {
+    int file_fd = open(image_file, O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0) { perror("open image file"); return -1; }
+    int ctl_fd = open("/dev/loop-control", O_RDWR | O_CLOEXEC);
+    if (ctl_fd < 0) { perror("open /dev/loop-control"); close(file_fd); return -1; }
+
+    int loop_fd = -1;
+    for (int attempt = 0; attempt < 8 && loop_fd < 0; attempt++) {
+        int n = ioctl(ctl_fd, LOOP_CTL_GET_FREE);
+        if (n < 0) { perror("LOOP_CTL_GET_FREE"); break; }
+        snprintf(loop_path, size, "/dev/loop%d", n);
+        loop_fd = open(loop_path, O_RDONLY | O_CLOEXEC);
+        if (loop_fd < 0) { perror("open loop device"); break; }
+        if (ioctl(loop_fd, LOOP_SET_FD, file_fd) != 0) {
+            // Another process grabbed the same free device; ask again.
+            int err = errno;
+            close(loop_fd);
+            loop_fd = -1;
+            if (err != EBUSY) { errno = err; perror("LOOP_SET_FD"); break; }
+        }
+    }
+    close(ctl_fd);
+    close(file_fd);
+    if (loop_fd < 0) return -1;
+
+    struct loop_info64 info;
+    memset(&info, 0, sizeof(info));
+    info.lo_flags = LO_FLAGS_AUTOCLEAR;
+    snprintf((char *)info.lo_file_name, sizeof(info.lo_file_name), "%s", image_file);
+    if (ioctl(loop_fd, LOOP_SET_STATUS64, &info) != 0) {
+        perror("LOOP_SET_STATUS64");
+        ioctl(loop_fd, LOOP_CLR_FD, 0);
+        close(loop_fd);
+        return -1;
     }
+    return loop_fd;
+}
 
-    snprintf(path_buffer, sizeof(path_buffer), "%s/image_name", state_dir);
-    write_file(path_buffer, image_name);
+int lock_image_dir(const char *image_dir) {
+    char lock_path[PATH_MAX];
+    snprintf(lock_path, sizeof(lock_path), "%s/lock", image_dir);
+    int fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) { perror("open image lock"); return -1; }
+    if (flock(fd, LOCK_EX) != 0) { perror("flock image lock"); close(fd); return -1; }
+    return fd;
+}
 
-    char random_id_str[16];
-    snprintf(random_id_str, sizeof(random_id_str), "%d", random_id);
-    snprintf(path_buffer, sizeof(path_buffer), "%s/overlay_id", state_dir);
-    write_file(path_buffer, random_id_str);
+int image_rootfs_path(const char *image_file, char *rootfs, size_t size) {
+    char key[NAME_MAX];
+    if (image_key(image_file, key, sizeof(key)) != 0) return -1;
+    snprintf(rootfs, size, "%s/%s/rootfs", MY_RUNTIME_IMAGES, key);
+    return 0;
+}
 
-    if (detach_flag) {
-        snprintf(path_buffer, sizeof(path_buffer), "%s/detach", state_dir);
-        write_file(path_buffer, "1");
+// Makes sure the image is mounted and returns its mount point in lowerdir.
+// take_ref is set by run (a new user); start only remounts if needed.
+int acquire_image_file(const char *image_file, char *lowerdir, size_t size, int take_ref) {
+    char key[NAME_MAX], image_dir[PATH_MAX], path_buffer[PATH_MAX];
+    const char *fs_type = detect_image_fs_type(image_file);
+    if (fs_type == NULL) {
+        fprintf(stderr, "Error: '%s' is not an EROFS or squashfs image.\n", image_file);
+        return -1;
     }
-
-    if (share_ipc_flag) {
-        snprintf(path_buffer, sizeof(path_buffer), "%s/share_ipc", state_dir);
-        write_file(path_buffer, "1");
+    if (image_key(image_file, key, sizeof(key)) != 0) { perror("realpath image"); return -1; }
+    mkdir(MY_RUNTIME_IMAGES, 0755);
+    snprintf(image_dir, sizeof(image_dir), "%s/%s", MY_RUNTIME_IMAGES, key);
+    mkdir(image_dir, 0755);
+    snprintf(lowerdir, size, "%s/rootfs", image_dir);
+
+    int lock_fd = lock_image_dir(image_dir);
+    if (lock_fd < 0) return -1;
+    // Under the lock, so a concurrent last release cannot remove it again.
+    mkdir(lowerdir, 0755);
+
+    int ret = 0;
+    if (!is_mount_point(lowerdir)) {
+        char loop_path[64];
+        int loop_fd = attach_loop_device(image_file, loop_path, sizeof(loop_path));
+        if (loop_fd < 0) {
+            ret = -1;
+        } else {
+            if (mount(loop_path, lowerdir, fs_type, MS_RDONLY | MS_NODEV | MS_NOSUID, NULL) != 0) {
+                perror("Image mount failed");
+                ioctl(loop_fd, LOOP_CLR_FD, 0);
+                ret = -1;
+            }
+            close(loop_fd);
+        }
     }
-
-    if (propagate_mount_dir) {
-        snprintf(path_buffer, sizeof(path_buffer), "%s/propagate_mount_dir", state_dir);
-        write_file(path_buffer, propagate_mount_dir);
+    if (ret == 0 && take_ref) {
+        snprintf(path_buffer, sizeof(path_buffer), "%s/refcount", image_dir);
+        long refs = read_cgroup_long(path_buffer);
+        char refs_str[32];
+        snprintf(refs_str, sizeof(refs_str), "%ld", refs > 0 ? refs + 1 : 1);
+        write_file(path_buffer, refs_str);
     }
+    close(lock_fd);
+    return ret;
+}
 
-    if (pin_cpu_flag) {
-        snprintf(path_buffer, sizeof(path_buffer), "%s/pin_cpu", state_dir);
-        write_file(path_buffer, "1");
-        FILE *f = fopen(NEXT_CPU_FILE, "r+");
-        int next_cpu = 0;
-        if (f) { fscanf(f, "%d", &next_cpu); }
-        else { f = fopen(NEXT_CPU_FILE, "w"); }
-        long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
-        int target_cpu = next_cpu % num_cpus;
-        cpu_set_t cpuset;
-        CPU_ZERO(&cpuset);
-        CPU_SET(target_cpu, &cpuset);
-        if (sched_setaffinity(container_pid, sizeof(cpu_set_t), &cpuset) != 0) {
-            perror("sched_setaffinity failed");
-        }
-        struct sched_param param = { .sched_priority = 50 };
-        if (sched_setscheduler(container_pid, SCHED_RR, &param) != 0) {
-            perror("sched_setscheduler failed");
+void release_image_file(const char *image_file) {
+    char key[NAME_MAX], image_dir[PATH_MAX], path_buffer[PATH_MAX], rootfs[PATH_MAX];
+    if (image_key(image_file, key, sizeof(key)) != 0) return;
+    snprintf(image_dir, sizeof(image_dir), "%s/%s", MY_RUNTIME_IMAGES, key);
+    if (access(image_dir, F_OK) != 0) return;
+
+    int lock_fd = lock_image_dir(image_dir);
+    if (lock_fd < 0) return;
+    snprintf(path_buffer, sizeof(path_buffer), "%s/refcount", image_dir);
+    long refs = read_cgroup_long(path_buffer) - 1;
+    if (refs > 0) {
+        char refs_str[32];
+        snprintf(refs_str, sizeof(refs_str), "%ld", refs);
+        write_file(path_buffer, refs_str);
+    } else {
+        snprintf(rootfs, sizeof(rootfs), "%s/rootfs", image_dir);
+        if (umount2(rootfs, MNT_DETACH) != 0 && errno != EINVAL && errno != ENOENT) {
+            perror("umount2 image failed");
         }
-        fseek(f, 0, SEEK_SET);
-        fprintf(f, "%d", (next_cpu + 1) % num_cpus);
-        fclose(f);
+        unlink(path_buffer);
+        rmdir(rootfs);
     }
-    if (mem_limit) {
-        snprintf(path_buffer, sizeof(path_buffer), "%s/mem_limit", state_dir);
-        write_file(path_buffer, mem_limit);
-        snprintf(path_buffer, sizeof(path_buffer), "%s/memory.max", cgroup_path);
-        write_file(path_buffer, mem_limit);
-        snprintf(path_buffer, sizeof(path_buffer), "%s/memory.swap.max", cgroup_path);
-        write_file(path_buffer, "0");
+    close(lock_fd);
+}
+
+// Like resolve_lowerdir, but never mounts anything.
+int lookup_lowerdir(const char *image_name, char *lowerdir, size_t size) {
+    if (is_image_file(image_name)) {
+        return image_rootfs_path(image_name, lowerdir, size);
     }
-    if (cpu_quota) {
-        snprintf(path_buffer, sizeof(path_buffer), "%s/cpu_quota", state_dir);
-        write_file(path_buffer, cpu_quota);
-        char cpu_content[64];
-        snprintf(path_buffer, sizeof(path_buffer), "%s/cpu.max", cgroup_path);
-        snprintf(cpu_content, sizeof(cpu_content), "%s 100000", cpu_quota);
-        write_file(path_buffer, cpu_content);
+    snprintf(lowerdir, size, "%s", image_name);
+    return 0;
+}
+
+// Resolves the overlay lowerdir for an image: directories are used as-is,
+// image files go through the shared loop mount.
+int resolve_lowerdir(const char *image_name, char *lowerdir, size_t size, int take_ref) {
+    if (is_image_file(image_name)) {
+        return acquire_image_file(image_name, lowerdir, size, take_ref);
     }
-    if (io_read_bps || io_write_bps) {
-        snprintf(path_buffer, sizeof(path_buffer), "%s/io_read_bps", state_dir);
-        write_file(path_buffer, io_read_bps ? io_read_bps : "max");
-        snprintf(path_buffer, sizeof(path_buffer), "%s/io_write_bps", state_dir);
-        write_file(path_buffer, io_write_bps ? io_write_bps : "max");
-        char io_content[128];
-        snprintf(io_content, sizeof(io_content), "8:0 rbps=%s wbps=%s",
-                 io_read_bps ? io_read_bps : "max", io_write_bps ? io_write_bps : "max");
-        snprintf(path_buffer, sizeof(path_buffer), "%s/io.max", cgroup_path);
-        write_file(path_buffer, io_content);
+    snprintf(lowerdir, size, "%s", image_name);
+    return 0;
+}
+
+
+// ---------- Overlay -----------
+
+struct overlay_config {
+    char ephemeral_size[32];    // non-empty: upper/work live on a tmpfs of this size
+    int metacopy;
+    int index;
+};
+
+void load_overlay_config(const char *state_dir, struct overlay_config *cfg) {
+    char path_buffer[PATH_MAX];
+    snprintf(path_buffer, sizeof(path_buffer), "%s/ephemeral", state_dir);
+    read_file_string(path_buffer, cfg->ephemeral_size, sizeof(cfg->ephemeral_size));
+    snprintf(path_buffer, sizeof(path_buffer), "%s/overlay_metacopy", state_dir);
+    cfg->metacopy = access(path_buffer, F_OK) == 0;
+    snprintf(path_buffer, sizeof(path_buffer), "%s/overlay_index", state_dir);
+    cfg->index = access(path_buffer, F_OK) == 0;
+}
+
+void save_overlay_config(const char *state_dir, const struct overlay_config *cfg) {
+    char path_buffer[PATH_MAX];
+    if (cfg->ephemeral_size[0] != '\0') {
+        snprintf(path_buffer, sizeof(path_buffer), "%s/ephemeral", state_dir);
+        write_file(path_buffer, cfg->ephemeral_size);
+    }
+    if (cfg->metacopy) {
+        snprintf(path_buffer, sizeof(path_buffer), "%s/overlay_metacopy", state_dir);
+        write_file(path_buffer, "1");
+    }
+    if (cfg->index) {
+        snprintf(path_buffer, sizeof(path_buffer), "%s/overlay_index", state_dir);
+        write_file(path_buffer, "1");
+    }
+}
+
+void overlay_upper_path(const char *overlay_id, const struct overlay_config *cfg, char *upperdir, size_t size) {
+    if (cfg->ephemeral_size[0] != '\0') {
+        snprintf(upperdir, size, "overlay_layers/%s/scratch/upper", overlay_id);
+    } else {
+        snprintf(upperdir, size, "overlay_layers/%s/upper", overlay_id);
     }
+}
 
-    char procs_path[PATH_MAX];
-    snprintf(procs_path, sizeof(procs_path), "%s/cgroup.procs", cgroup_path);
-    snprintf(pid_str, sizeof(pid_str), "%d", container_pid);
-    write_file(procs_path, pid_str);
+// Picks a fresh overlay id by creating overlay_layers/<id> with mkdir(),
+// which fails if the directory exists, so two containers never share a layer.
+int reserve_overlay_id(char *overlay_id, size_t size) {
+    if (mkdir("overlay_layers", 0755) != 0 && errno != EEXIST) { perror("mkdir overlay_layers"); return -1; }
+    char path_buffer[PATH_MAX];
+    for (int attempt = 0; attempt < 1000; attempt++) {
+        snprintf(overlay_id, size, "%d", rand() % 1000000);
+        snprintf(path_buffer, sizeof(path_buffer), "overlay_layers/%s", overlay_id);
+        if (mkdir(path_buffer, 0755) == 0) return 0;
+        if (errno != EEXIST) { perror("mkdir overlay layer"); return -1; }
+    }
+    fprintf(stderr, "Error: Could not find a free overlay id.\n");
+    return -1;
+}
 
-    if (detach_flag) {
-        printf("Container started with PID %d\n", container_pid);
-        return 0;
+// Mounts the container's overlay at overlay_layers/<id>/merged.
+// An ephemeral container gets a fresh, size-capped tmpfs for upper and work
+// on every mount and uses "volatile", so overlayfs never calls syncfs on it.
+// Whatever the previous run wrote is thrown away.
+int mount_container_overlay(const char *overlay_id, const char *lowerdir, const struct overlay_config *cfg,
+                            char *merged, size_t size) {
+    char upperdir[PATH_MAX], workdir[PATH_MAX], command[PATH_MAX * 3];
+    snprintf(merged, size, "overlay_layers/%s/merged", overlay_id);
+    overlay_upper_path(overlay_id, cfg, upperdir, sizeof(upperdir));
+
+    if (cfg->ephemeral_size[0] != '\0') {
+        char scratch[PATH_MAX], tmpfs_opts[64];
+        snprintf(scratch, sizeof(scratch), "overlay_layers/%s/scratch", overlay_id);
+        snprintf(workdir, sizeof(workdir), "%s/work", scratch);
+        snprintf(command, sizeof(command), "mkdir -p %s %s", merged, scratch);
+        if (system(command) != 0) { return -1; }
+        umount2(scratch, MNT_DETACH);
+        snprintf(tmpfs_opts, sizeof(tmpfs_opts), "size=%s,mode=0755", cfg->ephemeral_size);
+        if (mount("tmpfs", scratch, "tmpfs", MS_NOSUID | MS_NODEV, tmpfs_opts) != 0) {
+            perror("tmpfs mount for ephemeral layer failed");
+            return -1;
+        }
+        mkdir(upperdir, 0755);
+        mkdir(workdir, 0755);
+    } else {
+        snprintf(workdir, sizeof(workdir), "overlay_layers/%s/work", overlay_id);
+        snprintf(command, sizeof(command), "mkdir -p %s %s %s", upperdir, workdir, merged);
+        if (system(command) != 0) { return -1; }
     }
 
-    printf("Container started with PID %d. Press Ctrl+C to stop.\n", container_pid);
-    waitpid(container_pid, NULL, 0);
-    printf("Container %d has exited. Use 'rm' to clean up.\n", container_pid);
+    char mount_opts[PATH_MAX * 3 + 128];
+    int len = snprintf(mount_opts, sizeof(mount_opts), "lowerdir=%s,upperdir=%s,workdir=%s", lowerdir, upperdir, workdir);
+    if (cfg->ephemeral_size[0] != '\0') {
+        len += snprintf(mount_opts + len, sizeof(mount_opts) - len, ",volatile");
+    }
+    if (cfg->metacopy) {
+        len += snprintf(mount_opts + len, sizeof(mount_opts) - len, ",metacopy=on,redirect_dir=on");
+    }
+    if (cfg->index) {
+        snprintf(mount_opts + len, sizeof(mount_opts) - len, ",index=on");
+    }
+    if (mount("overlay", merged, "overlay", 0, mount_opts) != 0) {
+        perror("Overlay mount failed");
+        return -1;
+    }
     return 0;
 }
 
+// Undoes mount_container_overlay() for a container that never got created.
+void discard_container_overlay(const char *overlay_id) {
+    char path_buffer[PATH_MAX], command[PATH_MAX];
+    snprintf(path_buffer, sizeof(path_buffer), "overlay_layers/%s/merged", overlay_id);
+    umount2(path_buffer, MNT_DETACH);
+    snprintf(path_buffer, sizeof(path_buffer), "overlay_layers/%s/scratch", overlay_id);
+    umount2(path_buffer, MNT_DETACH);
+    snprintf(command, sizeof(command), "rm -rf overlay_layers/%s", overlay_id);
+    system(command);
+}
 
-int do_list(int argc, char *argv[]) {
-    DIR *d = opendir(MY_RUNTIME_STATE);
-    if (d == NULL) {
-        if (errno == ENOENT) {
-            printf("No containers exist.\n");
-            return 0;
+// Copy-up state of one container, derived from a walk of its upper layer
+// at the time of the call: every upper entry that shadows a lower one was
+// copied up, either in full or, with metacopy, as metadata only.
+struct copy_up_stats {
+    long data_copy_ups;
+    long metadata_copy_ups;
+    long copied_bytes;
+    long new_files;
+    long renames;
+    long whiteouts;
+};
+
+// Reads an overlay xattr into buf; returns its length or -1.
+ssize_t overlay_xattr(const char *path, const char *name, char *buf, size_t size) {
+    ssize_t len = lgetxattr(path, name, buf, size - 1);
+    if (len >= 0) buf[len] = '\0';
+    return len;
+}
+
+// lower is the matching lower path, or NULL when nothing below can show
+// through (under an opaque directory). lower_root resolves absolute
+// redirects, which redirect_dir and metacopy write for renamed entries.
+void scan_upper_dir(const char *upper, const char *lower, const char *lower_root, struct copy_up_stats *stats) {
+    DIR *d = opendir(upper);
+    if (d == NULL) return;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        char upper_path[PATH_MAX], lower_path[PATH_MAX], xattr[PATH_MAX];
+        snprintf(upper_path, sizeof(upper_path), "%s/%s", upper, entry->d_name);
+        struct stat st, lower_st;
+        if (lstat(upper_path, &st) != 0) continue;
+
+        int has_lower = lower != NULL;
+        if (overlay_xattr(upper_path, "trusted.overlay.redirect", xattr, sizeof(xattr)) > 0 &&
+            (xattr[0] == '/' || has_lower)) {
+            // Absolute redirects are relative to the layer root, others to
+            // the parent directory.
+            if (xattr[0] == '/') {
+                snprintf(lower_path, sizeof(lower_path), "%s%s", lower_root, xattr);
+            } else {
+                snprintf(lower_path, sizeof(lower_path), "%s/%s", lower, xattr);
+            }
+            has_lower = 1;
+            stats->renames++;
+        } else if (has_lower) {
+            snprintf(lower_path, sizeof(lower_path), "%s/%s", lower, entry->d_name);
+        }
+        if (has_lower && lstat(lower_path, &lower_st) != 0) has_lower = 0;
+
+        if (S_ISCHR(st.st_mode) && st.st_rdev == 0) {
+            stats->whiteouts++;
+        } else if (S_ISDIR(st.st_mode)) {
+            int opaque = overlay_xattr(upper_path, "trusted.overlay.opaque", xattr, sizeof(xattr)) > 0 && xattr[0] == 'y';
+            scan_upper_dir(upper_path, has_lower && !opaque ? lower_path : NULL, lower_root, stats);
+        } else if (!has_lower) {
+            stats->new_files++;
+        } else if (lgetxattr(upper_path, "trusted.overlay.metacopy", NULL, 0) >= 0) {
+            stats->metadata_copy_ups++;
+        } else {
+            stats->data_copy_ups++;
+            stats->copied_bytes += (long)st.st_blocks * 512;
         }
-        perror("opendir");
-        return 1;
     }
+    closedir(d);
+}
 
-    struct dirent *dir_entry;
-    int found = 0;
 
-    while ((dir_entry = readdir(d)) != NULL) {
-        if (dir_entry->d_type != DT_DIR || strcmp(dir_entry->d_name, ".") == 0 || strcmp(dir_entry->d_name, "..") == 0)
-            continue;
+// ---------- Exec -----------
 
-        if (!found) {
-            printf("%-15s\t%-10s\t%s\n", "CONTAINER PID", "STATUS", "COMMAND");
-            found = 1;
-        }
+// Everything needed to launch a process inside a running container. exec
+// --batch keeps these open, so a probe costs two forks and one setns()
+// instead of /proc path walks per namespace.
+struct exec_target {
+    pid_t pid;
+    int pidfd;
+    int root_fd;            // the container init's root, for chroot
+    int cgroup_procs_fd;    // -1 if the container has no cgroup
+    int ns_flags;           // namespaces that differ from ours
+};
 
-        char proc_path[PATH_MAX];
-        snprintf(proc_path, sizeof(proc_path), "/proc/%s", dir_entry->d_name);
-        const char* status = (access(proc_path, F_OK) == 0) ? "Running" : "Stopped";
+static const struct {
+    const char *name;
+    int flag;
+} exec_namespaces[] = {
+    { "user", CLONE_NEWUSER },
+    { "mnt", CLONE_NEWNS },
+    { "pid", CLONE_NEWPID },
+    { "net", CLONE_NEWNET },
+    { "uts", CLONE_NEWUTS },
+    { "ipc", CLONE_NEWIPC },
+    { "cgroup", CLONE_NEWCGROUP },
+};
 
-        char cmd_path[PATH_MAX], cmd_buf[1024] = {0};
-        snprintf(cmd_path, sizeof(cmd_path), "%s/%s/command", MY_RUNTIME_STATE, dir_entry->d_name);
-        FILE *cmd_file = fopen(cmd_path, "r");
-        if (cmd_file) {
-            fgets(cmd_buf, sizeof(cmd_buf) - 1, cmd_file);
-            cmd_buf[strcspn(cmd_buf, "\n")] = 0;
-            fclose(cmd_file);
+// Only namespaces the container does not share with us are joined: once in
+// the container's user namespace we could not re-enter a host-owned one
+// (e.g. the host IPC namespace of a --share-ipc container).
+int container_ns_flags(pid_t pid) {
+    int flags = 0;
+    for (size_t i = 0; i < sizeof(exec_namespaces) / sizeof(exec_namespaces[0]); i++) {
+        char self_path[64], target_path[64];
+        struct stat self_st, target_st;
+        snprintf(self_path, sizeof(self_path), "/proc/self/ns/%s", exec_namespaces[i].name);
+        snprintf(target_path, sizeof(target_path), "/proc/%d/ns/%s", pid, exec_namespaces[i].name);
+        if (stat(self_path, &self_st) != 0 || stat(target_path, &target_st) != 0) continue;
+        if (self_st.st_ino != target_st.st_ino || self_st.st_dev != target_st.st_dev) {
+            flags |= exec_namespaces[i].flag;
         }
+    }
+    return flags;
+}
 
-        printf("%-15s\t%-10s\t%s\n", dir_entry->d_name, status, cmd_buf);
+int open_exec_target(const char *pid_str, struct exec_target *target) {
+    char path_buffer[PATH_MAX];
+    memset(target, 0, sizeof(*target));
+    target->pid = atoi(pid_str);
+    target->pidfd = target->root_fd = target->cgroup_procs_fd = -1;
+
+    snprintf(path_buffer, sizeof(path_buffer), "%s/%s", MY_RUNTIME_STATE, pid_str);
+    if (target->pid <= 0 || access(path_buffer, F_OK) != 0) {
+        fprintf(stderr, "Error: No container with PID %s found.\n", pid_str);
+        return -1;
+    }
+    target->pidfd = syscall(SYS_pidfd_open, target->pid, 0);
+    if (target->pidfd < 0) {
+        if (errno == ESRCH) fprintf(stderr, "Error: Container %s is not running.\n", pid_str);
+        else perror("pidfd_open failed (exec needs Linux 5.8 or newer)");
+        return -1;
     }
+    snprintf(path_buffer, sizeof(path_buffer), "/proc/%d/root", target->pid);
+    target->root_fd = open(path_buffer, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (target->root_fd < 0) {
+        perror("open container root");
+        close(target->pidfd);
+        return -1;
+    }
+    snprintf(path_buffer, sizeof(path_buffer), "%s/container_%s/cgroup.procs", MY_RUNTIME_CGROUP, pid_str);
+    target->cgroup_procs_fd = open(path_buffer, O_WRONLY | O_CLOEXEC);
+    target->ns_flags = container_ns_flags(target->pid);
+    return 0;
+}
 
-    closedir(d);
+void close_exec_target(struct exec_target *target) {
+    if (target->pidfd >= 0) close(target->pidfd);
+    if (target->root_fd >= 0) close(target->root_fd);
+    if (target->cgroup_procs_fd >= 0) close(target->cgroup_procs_fd);
+    target->pidfd = target->root_fd = target->cgroup_procs_fd = -1;
+}
 
-    if (!found) {
-        printf("No containers exist.\n");
+// Forks a helper that joins the container's cgroup and, with one
+// setns(pidfd) call, all of its namespaces. A PID namespace only applies to
+// children, so the helper forks once more to chroot and exec the command,
+// then exits with the command's status (128 + signal if it was killed).
+pid_t spawn_in_container(const struct exec_target *target, char **cmd_argv, int quiet) {
+    pid_t helper = fork();
+    if (helper != 0) return helper;
+
+    if (target->cgroup_procs_fd >= 0 && write(target->cgroup_procs_fd, "0", 1) != 1) {
+        perror("join container cgroup");
+    }
+    if (target->ns_flags != 0 && setns(target->pidfd, target->ns_flags) != 0) {
+        perror("setns failed");
+        _exit(126);
+    }
+    if (target->ns_flags & CLONE_NEWUSER) {
+        // Become the container's root; setgroups is denied in its user ns.
+        if (setresgid(0, 0, 0) != 0 || setresuid(0, 0, 0) != 0) {
+            perror("switch to container root");
+        }
+    }
+
+    pid_t child = fork();
+    if (child == 0) {
+        if (quiet) {
+            // Opened before chroot: images need not ship /dev/null.
+            int devnull = open("/dev/null", O_RDWR);
+            if (devnull >= 0) {
+                dup2(devnull, STDIN_FILENO);
+                dup2(devnull, STDOUT_FILENO);
+                dup2(devnull, STDERR_FILENO);
+                if (devnull > STDERR_FILENO) close(devnull);
+            }
+        }
+        if (fchdir(target->root_fd) != 0 || chroot(".") != 0 || chdir("/") != 0) {
+            perror("chroot into container failed");
+            _exit(126);
+        }
+        execv(cmd_argv[0], cmd_argv);
+        perror("execv failed");
+        _exit(127);
+    }
+    if (child < 0) {
+        perror("fork in container");
+        _exit(126);
     }
+    int status;
+    if (waitpid(child, &status, 0) < 0) _exit(126);
+    _exit(WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+}
+
+int exit_code_from_status(int status) {
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+long elapsed_usec(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000L;
+}
+
+
+// ---------- Prefetch -----------
+
+// A prefetch profile lists the parts of an image a container read while
+// starting up, one "offset length path" line per range, with paths relative
+// to the image root and ranges of one file on consecutive lines. It lives
+// under MY_RUNTIME_PREFETCH, keyed like the image mounts, so it survives
+// reboots and is shared by every container of the image.
 
+int prefetch_profile_path(const char *image_name, char *path, size_t size) {
+    char key[NAME_MAX];
+    if (image_key(image_name, key, sizeof(key)) != 0) return -1;
+    snprintf(path, size, "%s/%s", MY_RUNTIME_PREFETCH, key);
     return 0;
 }
 
-int do_status(int argc, char *argv[]) {
-    if (argc < 2) { fprintf(stderr, "Usage: %s status <container_pid>\n", argv[0]); return 1; }
-    char *pid_str = argv[1];
-    char path_buffer[PATH_MAX], format_buffer[64];
-    char state_dir[PATH_MAX]; snprintf(state_dir, sizeof(state_dir), "%s/%s", MY_RUNTIME_STATE, pid_str);
-    if (access(state_dir, F_OK) != 0) { fprintf(stderr, "Error: No container with PID %s found.\n", pid_str); return 1; }
-    printf("--- Status for Container PID %s ---\n", pid_str);
-    snprintf(path_buffer, sizeof(path_buffer), "%s/command", state_dir);
-    FILE *f = fopen(path_buffer, "r");
-    if (f) {
-        char cmd_buf[1024] = {0}; fgets(cmd_buf, sizeof(cmd_buf)-1, f);
-        cmd_buf[strcspn(cmd_buf, "\n")] = 0; printf("%-25s: %s\n", "Command", cmd_buf); fclose(f);
+// Returns the mincore() vector of a lower file (one byte per page) and its
+// page count, or NULL if the file is not a readable, non-empty regular file.
+unsigned char *file_residency(const char *lowerdir, const char *rel, size_t *pages) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", lowerdir, rel);
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) { close(fd); return NULL; }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    *pages = (st.st_size + page_size - 1) / page_size;
+    unsigned char *resident = malloc(*pages);
+    if (resident != NULL && mincore(map, st.st_size, resident) != 0) { free(resident); resident = NULL; }
+    munmap(map, st.st_size);
+    return resident;
+}
+
+// Writes the ranges of one lower file that entered the page cache while the
+// container ran. fanotify only says which files were opened, not which parts
+// were read, so this diffs mincore() against the snapshot taken before the
+// container's first open of the file; pages that were already cached (by
+// the host or other containers) are left out.
+void record_new_ranges(FILE *out, const char *lowerdir, const char *rel,
+                       const unsigned char *before, size_t before_pages) {
+    size_t pages;
+    unsigned char *resident = file_residency(lowerdir, rel, &pages);
+    if (resident == NULL) return;
+    long page_size = sysconf(_SC_PAGESIZE);
+    size_t start = 0;
+    for (size_t i = 0; i <= pages; i++) {
+        int was_cached = before != NULL && i < before_pages && (before[i] & 1);
+        if (i < pages && (resident[i] & 1) && !was_cached) continue;
+        if (i > start) {
+            fprintf(out, "%ld %ld %s\n", (long)(start * page_size), (long)((i - start) * page_size), rel);
+        }
+        start = i + 1;
     }
+    free(resident);
+}
 
-    
-    snprintf(path_buffer, sizeof(path_buffer), "%s/propagate_mount_dir", state_dir);
-    f = fopen(path_buffer, "r");
-    if (f) {
-        char p_dir[PATH_MAX] = {0};
-        fgets(p_dir, sizeof(p_dir)-1, f);
-        p_dir[strcspn(p_dir, "\n")] = 0;
-        printf("%-25s: %s\n", "Propagated Mount", p_dir);
-        fclose(f);
+// Marks the container's overlay before its init is released, so not even
+// the first exec is missed. Every container has its own overlay superblock,
+// so a filesystem mark sees exactly this container's opens. Opens are
+// permission events: the opener waits until the recorder has snapshotted
+// the file's residency and allowed the open.
+int open_prefetch_recorder(const char *merged) {
+    int fan_fd = fanotify_init(FAN_CLASS_CONTENT | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY | O_LARGEFILE);
+    if (fan_fd < 0) { perror("fanotify_init"); return -1; }
+    if (fanotify_mark(fan_fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, FAN_OPEN_PERM, AT_FDCWD, merged) != 0) {
+        perror("fanotify_mark");
+        close(fan_fd);
+        return -1;
     }
+    return fan_fd;
+}
 
+// Forks a detached recorder that collects the files the container opens for
+// the given number of seconds (or until it exits) and then writes the
+// profile. Takes ownership of fan_fd; closing it allows any open still
+// waiting for a response.
+void spawn_prefetch_recorder(int fan_fd, pid_t container_pid, const char *merged, const char *lowerdir,
+                             const char *profile, int seconds) {
+    char merged_real[PATH_MAX];
+    if (realpath(merged, merged_real) == NULL) { perror("realpath merged"); close(fan_fd); return; }
+    pid_t pid = fork();
+    if (pid < 0) { perror("fork prefetch recorder"); }
+    if (pid != 0) { close(fan_fd); return; }
+
+    setsid();
+    int null_fd = open("/dev/null", O_RDWR);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        if (null_fd > STDERR_FILENO) close(null_fd);
+    }
 
-    char cgroup_path[PATH_MAX]; snprintf(cgroup_path, sizeof(cgroup_path), "%s/container_%s", MY_RUNTIME_CGROUP, pid_str);
-    printf("\n--- Resources ---\n");
-    snprintf(path_buffer, sizeof(path_buffer), "%s/memory.current", cgroup_path);
-    long mem_current = read_cgroup_long(path_buffer);
-    format_bytes(mem_current, format_buffer, sizeof(format_buffer));
-    printf("%-25s: %s\n", "Memory Usage", format_buffer);
-    snprintf(path_buffer, sizeof(path_buffer), "%s/cpu.stat", cgroup_path);
-    long cpu_micros = find_cgroup_value(path_buffer, "usage_usec");
-    if (cpu_micros >= 0) { printf("%-25s: %.2f seconds\n", "Total CPU Time", (double)cpu_micros / 1000000.0); }
-    snprintf(path_buffer, sizeof(path_buffer), "%s/pids.current", cgroup_path);
-    long pids_current = read_cgroup_long(path_buffer);
-    printf("%-25s: %ld\n", "Active Processes/Threads", pids_current);
-    printf("\n----------------------------------\n");
-    return 0;
+    size_t prefix_len = strlen(merged_real);
+    char *seen[MAX_PREFETCH_FILES];
+    unsigned char *before[MAX_PREFETCH_FILES];
+    size_t before_pages[MAX_PREFETCH_FILES];
+    int num_seen = 0;
+    // A zombie still answers kill(pid, 0); the pidfd turns readable on exit.
+    int container_pidfd = syscall(SYS_pidfd_open, container_pid, 0);
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    char buf[8192] __attribute__((aligned(__alignof__(struct fanotify_event_metadata))));
+    while (container_pidfd >= 0 && elapsed_usec(&started) < (long)seconds * 1000000) {
+        struct pollfd pfds[2] = { { .fd = fan_fd, .events = POLLIN }, { .fd = container_pidfd, .events = POLLIN } };
+        if (poll(pfds, 2, 200) <= 0) continue;
+        if (pfds[1].revents & POLLIN) break;
+        ssize_t len = read(fan_fd, buf, sizeof(buf));
+        if (len <= 0) continue;
+        struct fanotify_event_metadata *event = (struct fanotify_event_metadata *)buf;
+        for (; FAN_EVENT_OK(event, len); event = FAN_EVENT_NEXT(event, len)) {
+            if (event->fd < 0) continue;
+            char fd_link[64], path[PATH_MAX];
+            snprintf(fd_link, sizeof(fd_link), "/proc/self/fd/%d", event->fd);
+            ssize_t path_len = readlink(fd_link, path, sizeof(path) - 1);
+            const char *rel = NULL;
+            // The mount is reached through the host path of the merged dir.
+            if (path_len > (ssize_t)prefix_len + 1) {
+                path[path_len] = '\0';
+                if (strncmp(path, merged_real, prefix_len) == 0 && path[prefix_len] == '/') rel = path + prefix_len + 1;
+            }
+            int known = rel == NULL;
+            for (int i = 0; i < num_seen && !known; i++) { known = strcmp(seen[i], rel) == 0; }
+            if (!known && num_seen < MAX_PREFETCH_FILES) {
+                before[num_seen] = file_residency(lowerdir, rel, &before_pages[num_seen]);
+                seen[num_seen++] = strdup(rel);
+            }
+            struct fanotify_response response = { .fd = event->fd, .response = FAN_ALLOW };
+            write(fan_fd, &response, sizeof(response));
+            close(event->fd);
+        }
+    }
+    close(fan_fd);
+    if (container_pidfd >= 0) close(container_pidfd);
+
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", profile, getpid());
+    mkdir("/var/lib/my_runtime", 0755);
+    mkdir(MY_RUNTIME_PREFETCH, 0755);
+    FILE *out = fopen(tmp_path, "w");
+    if (out == NULL) _exit(1);
+    for (int i = 0; i < num_seen; i++) { record_new_ranges(out, lowerdir, seen[i], before[i], before_pages[i]); }
+    if (fclose(out) != 0 || rename(tmp_path, profile) != 0) { unlink(tmp_path); _exit(1); }
+    _exit(0);
 }
 
-int do_freeze(int argc, char *argv[]) {
-    if (argc < 2) { fprintf(stderr, "Usage: %s freeze <container_pid>\n", argv[0]); return 1; }
-    char *pid_str = argv[1]; char freeze_path[PATH_MAX];
-    snprintf(freeze_path, sizeof(freeze_path), "%s/container_%s/cgroup.freeze", MY_RUNTIME_CGROUP, pid_str);
-    write_file(freeze_path, "1"); printf("Froze container %s.\n", pid_str); return 0;
+// Replays a profile with POSIX_FADV_WILLNEED from a few worker processes,
+// each taking every PREFETCH_WORKERS-th file. Returns the number of workers
+// started; the caller reaps them with finish_prefetch_replay().
+int start_prefetch_replay(const char *profile, const char *lowerdir, pid_t *workers) {
+    if (access(profile, R_OK) != 0) return 0;
+    int count = 0;
+    for (int w = 0; w < PREFETCH_WORKERS; w++) {
+        pid_t pid = fork();
+        if (pid < 0) { perror("fork prefetch worker"); break; }
+        if (pid > 0) { workers[count++] = pid; continue; }
+
+        FILE *f = fopen(profile, "r");
+        if (f == NULL) _exit(1);
+        char line[PATH_MAX + 64], current[PATH_MAX] = "";
+        int file_index = -1, fd = -1;
+        while (fgets(line, sizeof(line), f)) {
+            long offset, length;
+            int consumed = 0;
+            if (sscanf(line, "%ld %ld %n", &offset, &length, &consumed) != 2 || consumed == 0) continue;
+            char *rel = line + consumed;
+            rel[strcspn(rel, "\n")] = '\0';
+            if (strcmp(rel, current) != 0) {
+                snprintf(current, sizeof(current), "%s", rel);
+                file_index++;
+                if (fd >= 0) { close(fd); fd = -1; }
+                if (file_index % PREFETCH_WORKERS == w) {
+                    char path[PATH_MAX];
+                    snprintf(path, sizeof(path), "%s/%s", lowerdir, rel);
+                    fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+                }
+            }
+            if (fd >= 0) posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+        }
+        _exit(0);
+    }
+    return count;
 }
 
-int do_thaw(int argc, char *argv[]) {
-    if (argc < 2) { fprintf(stderr, "Usage: %s thaw <container_pid>\n", argv[0]); return 1; }
-    char *pid_str = argv[1]; char freeze_path[PATH_MAX];
-    snprintf(freeze_path, sizeof(freeze_path), "%s/container_%s/cgroup.freeze", MY_RUNTIME_CGROUP, pid_str);
-    write_file(freeze_path, "0"); printf("Thawed container %s.\n", pid_str); return 0;
+void finish_prefetch_replay(pid_t *workers, int count) {
+    for (int i = 0; i < count; i++) { waitpid(workers[i], NULL, 0); }
 }
 
-int do_stop(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s stop <container_pid>\n", argv[0]);
-        return 1;
-    }
-    pid_t pid = atoi(argv[1]);
-    printf("Stopping container %d...\n", pid);
-    if (kill(pid, SIGKILL) != 0) {
-        perror("kill failed");
-    } else {
-        
-        waitpid(pid, NULL, 0);
-        
-        cleanup_mounts(pid);
+int prefetch_profile_summary(const char *profile, long *files, long *bytes) {
+    FILE *f = fopen(profile, "r");
+    if (f == NULL) return -1;
+    char line[PATH_MAX + 64], current[PATH_MAX] = "";
+    *files = 0;
+    *bytes = 0;
+    while (fgets(line, sizeof(line), f)) {
+        long offset, length;
+        int consumed = 0;
+        if (sscanf(line, "%ld %ld %n", &offset, &length, &consumed) != 2 || consumed == 0) continue;
+        char *rel = line + consumed;
+        rel[strcspn(rel, "\n")] = '\0';
+        if (strcmp(rel, current) != 0) { snprintf(current, sizeof(current), "%s", rel); (*files)++; }
+        *bytes += length;
     }
-    printf("Container %d stopped.\n", pid);
+    fclose(f);
     return 0;
 }
 
 
+// ---------- Memory reclaim -----------
+
+// Working-set estimate of one container, from its memory.stat. Anon memory
+// (including shmem) and the active file list count in full; of the inactive
+// file list only as much as was refaulted since the last reclaim pass, since
+// refaults are inactive pages the workload turned out to need.
+struct memory_sample {
+    long current;
+    long anon;
+    long active_file;
+    long inactive_file;
+    long slab_unreclaimable;
+    long refault_file;
+    long working_set;
+};
 
-int do_start(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s start <stopped_container_pid>\n", argv[0]);
-        return 1;
+long memory_stat_value(const char *path, const char *key) {
+    long value = find_cgroup_value(path, key);
+    return value > 0 ? value : 0;
+}
+
+int sample_container_memory(const char *cgroup_path, const char *state_dir, struct memory_sample *sample) {
+    char path_buffer[PATH_MAX];
+    memset(sample, 0, sizeof(*sample));
+    snprintf(path_buffer, sizeof(path_buffer), "%s/memory.current", cgroup_path);
+    sample->current = read_cgroup_long(path_buffer);
+    if (sample->current < 0) return -1;
+
+    snprintf(path_buffer, sizeof(path_buffer), "%s/memory.stat", cgroup_path);
+    sample->anon = memory_stat_value(path_buffer, "active_anon") + memory_stat_value(path_buffer, "inactive_anon");
+    sample->active_file = memory_stat_value(path_buffer, "active_file");
+    sample->inactive_file = memory_stat_value(path_buffer, "inactive_file");
+    sample->slab_unreclaimable = memory_stat_value(path_buffer, "slab_unreclaimable");
+    sample->refault_file = find_cgroup_value(path_buffer, "workingset_refault_file");
+    if (sample->refault_file < 0) {
+        // Kernels before 5.9 only have the combined counter.
+        sample->refault_file = memory_stat_value(path_buffer, "workingset_refault");
     }
-    char *pid_str = argv[1];
+
+    snprintf(path_buffer, sizeof(path_buffer), "%s/reclaim_refaults", state_dir);
+    long last_refaults = read_cgroup_long(path_buffer);
+    // A counter below the baseline means the cgroup was recreated.
+    if (sample->refault_file >= 0 && last_refaults > sample->refault_file) last_refaults = 0;
+    long refaulted = 0;
+    if (last_refaults >= 0 && sample->refault_file > last_refaults) {
+        refaulted = (sample->refault_file - last_refaults) * sysconf(_SC_PAGESIZE);
+        if (refaulted > sample->inactive_file) refaulted = sample->inactive_file;
+    }
+    sample->working_set = sample->anon + sample->active_file + sample->slab_unreclaimable + refaulted;
+    if (sample->working_set > sample->current) sample->working_set = sample->current;
+    return 0;
+}
+
+// "some avg10" of memory.pressure, in percent; -1 if unavailable.
+double read_memory_pressure(const char *cgroup_path) {
     char path_buffer[PATH_MAX];
+    snprintf(path_buffer, sizeof(path_buffer), "%s/memory.pressure", cgroup_path);
+    FILE *f = fopen(path_buffer, "r");
+    if (!f) return -1;
+    double avg10 = -1;
+    if (fscanf(f, "some avg10=%lf", &avg10) != 1) avg10 = -1;
+    fclose(f);
+    return avg10;
+}
 
-    char proc_path[PATH_MAX];
-    snprintf(proc_path, sizeof(proc_path), "/proc/%s", pid_str);
-    if (access(proc_path, F_OK) == 0) {
-        fprintf(stderr, "Error: Container %s is already running.\n", pid_str);
-        return 1;
+// One reclaim pass: trims the container toward its working set through
+// memory.reclaim, at most max_step_pct percent of its usage at a time, and
+// not at all while it is already stalling on memory.
+int reclaim_container(const char *pid_str, double pressure_limit, int max_step_pct, int dry_run) {
+    char cgroup_path[PATH_MAX], state_dir[PATH_MAX], path_buffer[PATH_MAX];
+    char current_buf[64], ws_buf[64], amount_buf[64];
+    snprintf(cgroup_path, sizeof(cgroup_path), "%s/container_%s", MY_RUNTIME_CGROUP, pid_str);
+    snprintf(state_dir, sizeof(state_dir), "%s/%s", MY_RUNTIME_STATE, pid_str);
+
+    struct memory_sample sample;
+    if (sample_container_memory(cgroup_path, state_dir, &sample) != 0) {
+        fprintf(stderr, "Error: No memory statistics for container %s.\n", pid_str);
+        return -1;
     }
+    format_bytes(sample.current, current_buf, sizeof(current_buf));
+    format_bytes(sample.working_set, ws_buf, sizeof(ws_buf));
 
-    char old_state_dir[PATH_MAX];
-    snprintf(old_state_dir, sizeof(old_state_dir), "%s/%s", MY_RUNTIME_STATE, pid_str);
-    if (access(old_state_dir, F_OK) != 0) {
-        fprintf(stderr, "Error: No stopped container with ID %s found.\n", pid_str);
-        return 1;
+    double pressure = read_memory_pressure(cgroup_path);
+    if (pressure > pressure_limit) {
+        printf("Container %s: usage %s, working set ~%s, skipped (memory pressure %.2f%%)\n",
+               pid_str, current_buf, ws_buf, pressure);
+        return 0;
     }
 
-    printf("Starting container %s...\n", pid_str);
-    
-    char image_name[PATH_MAX] = {0};
-    char overlay_id[16] = {0};
-    char command_str[1024] = {0};
-    char mem_limit[32] = {0};
-    char cpu_quota[32] = {0};
-    int pin_cpu_flag = 0;
-    int share_ipc_flag = 0;
-    int original_detach_flag = 0;
-    char propagate_mount_dir[PATH_MAX] = {0};
+    long amount = sample.current - sample.working_set;
+    long max_step = sample.current / 100 * max_step_pct;
+    if (amount > max_step) amount = max_step;
+    if (amount < RECLAIM_MIN_BYTES) {
+        printf("Container %s: usage %s, working set ~%s, nothing to reclaim\n", pid_str, current_buf, ws_buf);
+        return 0;
+    }
+    format_bytes(amount, amount_buf, sizeof(amount_buf));
+    if (dry_run) {
+        printf("Container %s: usage %s, working set ~%s, would reclaim %s\n", pid_str, current_buf, ws_buf, amount_buf);
+        return 0;
+    }
 
-    snprintf(path_buffer, sizeof(path_buffer), "%s/image_name", old_state_dir);
-    read_file_string(path_buffer, image_name, sizeof(image_name));
+    snprintf(path_buffer, sizeof(path_buffer), "%s/memory.reclaim", cgroup_path);
+    int fd = open(path_buffer, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror("open memory.reclaim (needs Linux 5.19 or newer)");
+        return -1;
+    }
+    char request[32];
+    int len = snprintf(request, sizeof(request), "%ld", amount);
+    // EAGAIN means the kernel reclaimed less than asked; that is fine.
+    if (write(fd, request, len) < 0 && errno != EAGAIN) {
+        perror("memory.reclaim failed");
+    }
+    close(fd);
 
-    snprintf(path_buffer, sizeof(path_buffer), "%s/overlay_id", old_state_dir);
-    read_file_string(path_buffer, overlay_id, sizeof(overlay_id));
-    
-    snprintf(path_buffer, sizeof(path_buffer), "%s/command", old_state_dir);
-    read_file_string(path_buffer, command_str, sizeof(command_str));
+    // Refaults from here on tell the next pass what it took too much of.
+    snprintf(path_buffer, sizeof(path_buffer), "%s/memory.current", cgroup_path);
+    long after = read_cgroup_long(path_buffer);
+    char refaults_buf[32];
+    snprintf(refaults_buf, sizeof(refaults_buf), "%ld", sample.refault_file);
+    snprintf(path_buffer, sizeof(path_buffer), "%s/reclaim_refaults", state_dir);
+    write_file(path_buffer, refaults_buf);
+
+    format_bytes(after >= 0 ? sample.current - after : -1, amount_buf, sizeof(amount_buf));
+    printf("Container %s: usage %s, working set ~%s, reclaimed %s\n", pid_str, current_buf, ws_buf, amount_buf);
+    return 0;
+}
+
+
+// ---------- Warm restart -----------
+
+// stop --keep-warm pins a container's namespaces by bind-mounting its
+// /proc/<pid>/ns files under <state_dir>/ns and leaves the overlay and the
+// cgroup in place. start then only creates a new PID namespace (the kernel
+// tears the old one down with its init) and execs the command into the rest.
+// The pins stay while the container runs, so a crashed workload can be
+// started warm again.
+
+int has_pinned_namespaces(const char *state_dir) {
+    char path_buffer[PATH_MAX];
+    snprintf(path_buffer, sizeof(path_buffer), "%s/ns/mnt", state_dir);
+    return access(path_buffer, F_OK) == 0;
+}
+
+void unpin_namespaces(const char *state_dir) {
+    char ns_dir[PATH_MAX], pin[PATH_MAX];
+    snprintf(ns_dir, sizeof(ns_dir), "%s/ns", state_dir);
+    if (access(ns_dir, F_OK) != 0) return;
+    for (size_t i = 0; i < sizeof(exec_namespaces) / sizeof(exec_namespaces[0]); i++) {
+        snprintf(pin, sizeof(pin), "%s/%s", ns_dir, exec_namespaces[i].name);
+        if (umount2(pin, MNT_DETACH) != 0 && errno != ENOENT && errno != EINVAL) {
+            perror("umount2 namespace pin failed");
+        }
+        unlink(pin);
+    }
+    umount2(ns_dir, MNT_DETACH);
+    rmdir(ns_dir);
+}
+
+int pin_namespaces(pid_t pid, const char *state_dir) {
+    if (has_pinned_namespaces(state_dir)) return 0;
+    char ns_dir[PATH_MAX], pin[PATH_MAX], source[64];
+    snprintf(ns_dir, sizeof(ns_dir), "%s/ns", state_dir);
+    if (mkdir(ns_dir, 0700) != 0 && errno != EEXIST) { perror("mkdir ns pin dir"); return -1; }
+    // A private mount of its own, so the pins never propagate into the
+    // container's (or any other) mount namespace.
+    if (mount(ns_dir, ns_dir, NULL, MS_BIND, NULL) != 0 || mount(NULL, ns_dir, NULL, MS_PRIVATE, NULL) != 0) {
+        perror("Failed to make the ns pin dir private");
+        rmdir(ns_dir);
+        return -1;
+    }
+    int ns_flags = container_ns_flags(pid);
+    for (size_t i = 0; i < sizeof(exec_namespaces) / sizeof(exec_namespaces[0]); i++) {
+        if (!(ns_flags & exec_namespaces[i].flag) || exec_namespaces[i].flag == CLONE_NEWPID) continue;
+        snprintf(pin, sizeof(pin), "%s/%s", ns_dir, exec_namespaces[i].name);
+        snprintf(source, sizeof(source), "/proc/%d/ns/%s", pid, exec_namespaces[i].name);
+        int fd = open(pin, O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+        if (fd >= 0) close(fd);
+        if (fd < 0 || mount(source, pin, NULL, MS_BIND, NULL) != 0) {
+            perror("Failed to pin container namespace");
+            unpin_namespaces(state_dir);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Kills a container's init and waits for it to exit, even when it is not
+// our child (a detached container belongs to init once run returns).
+int kill_and_wait(pid_t pid) {
+    int pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd < 0) return -1;
+    if (syscall(SYS_pidfd_send_signal, pidfd, SIGKILL, NULL, 0) != 0) {
+        close(pidfd);
+        return -1;
+    }
+    struct pollfd pfd = { .fd = pidfd, .events = POLLIN };
+    poll(&pfd, 1, -1);
+    waitpid(pid, NULL, WNOHANG);
+    close(pidfd);
+    return 0;
+}
+
+int stop_container_warm(pid_t pid) {
+    char state_dir[PATH_MAX];
+    snprintf(state_dir, sizeof(state_dir), "%s/%d", MY_RUNTIME_STATE, pid);
+    if (access(state_dir, F_OK) != 0) { fprintf(stderr, "Error: No container with PID %d found.\n", pid); return 1; }
+    if (kill(pid, 0) != 0) { fprintf(stderr, "Error: Container %d is not running.\n", pid); return 1; }
+    printf("Stopping container %d (keeping it warm)...\n", pid);
+    if (pin_namespaces(pid, state_dir) != 0) { return 1; }
+    if (kill_and_wait(pid) != 0) {
+        perror("kill failed");
+        return 1;
+    }
+    printf("Container %d stopped; its overlay, cgroup and namespaces are kept for a warm start.\n", pid);
+    return 0;
+}
+
+int process_is_running(const char *pid_str) {
+    char path_buffer[PATH_MAX], stat_buf[512];
+    snprintf(path_buffer, sizeof(path_buffer), "/proc/%s/stat", pid_str);
+    read_file_string(path_buffer, stat_buf, sizeof(stat_buf));
+    // The state follows the parenthesised command name; a zombie has exited.
+    char *end = strrchr(stat_buf, ')');
+    return end != NULL && end[1] == ' ' && end[2] != 'Z';
+}
+
+int warm_init_main(void *arg) {
+    struct container_args *args = (struct container_args *)arg;
+    char buf;
+    if (read(args->sync_pipe_read_fd, &buf, 1) != 1) {
+        perror("Failed to read from sync pipe");
+    }
+    close(args->sync_pipe_read_fd);
+
+    if (container_stdio_fd >= 0) {
+        dup2(container_stdio_fd, STDIN_FILENO);
+        dup2(container_stdio_fd, STDOUT_FILENO);
+        dup2(container_stdio_fd, STDERR_FILENO);
+    }
+
+    if (chroot(args->merged_path) != 0) { perror("chroot failed"); return 1; }
+    if (chdir("/") != 0) { perror("chdir failed"); return 1; }
+    // The /proc still mounted here belongs to the dead PID namespace.
+    umount2("/proc", MNT_DETACH);
+    if (mount("proc", "/proc", "proc", 0, NULL) != 0) { perror("mount proc failed"); }
+
+    execv(args->argv[0], args->argv);
+    perror("execv failed");
+    return 1;
+}
+
+// Launches the new init inside the pinned namespaces and its old cgroup.
+// A helper joins them and unshares a PID namespace; the init it clones with
+// CLONE_PARENT becomes our child, so the caller can wait for it. Returns the
+// init's PID, which waits on sync_read_fd before it execs.
+pid_t spawn_warm_init(const char *state_dir, const char *cgroup_path, char *root, char **cmd_argv, int sync_read_fd) {
+    char path_buffer[PATH_MAX];
+    int ns_fds[sizeof(exec_namespaces) / sizeof(exec_namespaces[0])];
+    for (size_t i = 0; i < sizeof(exec_namespaces) / sizeof(exec_namespaces[0]); i++) {
+        snprintf(path_buffer, sizeof(path_buffer), "%s/ns/%s", state_dir, exec_namespaces[i].name);
+        ns_fds[i] = open(path_buffer, O_RDONLY | O_CLOEXEC);
+    }
+    int pid_pipe[2];
+    if (pipe2(pid_pipe, O_CLOEXEC) != 0) { perror("pipe"); return -1; }
+
+    pid_t helper = fork();
+    if (helper == 0) {
+        close(pid_pipe[0]);
+        snprintf(path_buffer, sizeof(path_buffer), "%s/cgroup.procs", cgroup_path);
+        write_file(path_buffer, "0");
+        // The user namespace comes first: it owns the others and the new
+        // PID namespace, and grants the capabilities to join them.
+        for (size_t i = 0; i < sizeof(exec_namespaces) / sizeof(exec_namespaces[0]); i++) {
+            if (ns_fds[i] < 0) continue;
+            if (setns(ns_fds[i], exec_namespaces[i].flag) != 0) { perror("setns failed"); _exit(1); }
+            if (exec_namespaces[i].flag == CLONE_NEWUSER) {
+                if (setresgid(0, 0, 0) != 0 || setresuid(0, 0, 0) != 0) { perror("switch to container root"); }
+            }
+        }
+        // Always give the new init a fresh PID namespace, also for containers
+        // that were started without a user namespace.
+        if (unshare(CLONE_NEWPID) != 0) { perror("unshare pid namespace"); _exit(1); }
+        struct container_args args;
+        memset(&args, 0, sizeof(args));
+        args.merged_path = root;
+        args.argv = cmd_argv;
+        args.sync_pipe_read_fd = sync_read_fd;
+        char *stack = malloc(STACK_SIZE);
+        pid_t init_pid = clone(warm_init_main, stack + STACK_SIZE, CLONE_PARENT | SIGCHLD, &args);
+        if (init_pid < 0) { perror("clone failed on warm start"); _exit(1); }
+        if (write(pid_pipe[1], &init_pid, sizeof(init_pid)) != sizeof(init_pid)) _exit(1);
+        _exit(0);
+    }
+    for (size_t i = 0; i < sizeof(exec_namespaces) / sizeof(exec_namespaces[0]); i++) {
+        if (ns_fds[i] >= 0) close(ns_fds[i]);
+    }
+    close(pid_pipe[1]);
+    pid_t init_pid = -1;
+    if (helper < 0) {
+        perror("fork");
+    } else {
+        if (read(pid_pipe[0], &init_pid, sizeof(init_pid)) != sizeof(init_pid)) init_pid = -1;
+        waitpid(helper, NULL, 0);
+    }
+    close(pid_pipe[0]);
+    return init_pid;
+}
+
+// Starts a warm-stopped container. The cgroup keeps its limits and counters
+// and is only renamed to the new PID. Returns -1 before touching anything
+// if the container cannot be started warm, so the caller can start it cold.
+int warm_start_container(const char *pid_str, const char *overlay_id, char **cmd_argv, int detach_flag,
+                         int pin_cpu_flag, const struct sched_config *sched_cfg) {
+    char old_state_dir[PATH_MAX], merged[PATH_MAX], root[PATH_MAX], old_cgroup_path[PATH_MAX];
+    snprintf(old_state_dir, sizeof(old_state_dir), "%s/%s", MY_RUNTIME_STATE, pid_str);
+    snprintf(merged, sizeof(merged), "overlay_layers/%s/merged", overlay_id);
+    snprintf(old_cgroup_path, sizeof(old_cgroup_path), "%s/container_%s", MY_RUNTIME_CGROUP, pid_str);
+    if (!is_mount_point(merged) || realpath(merged, root) == NULL) {
+        fprintf(stderr, "Warning: overlay of container %s is gone; starting it cold.\n", pid_str);
+        return -1;
+    }
+
+    int sync_pipe[2];
+    if (pipe(sync_pipe) == -1) { perror("pipe"); return 1; }
+    pid_t new_pid = spawn_warm_init(old_state_dir, old_cgroup_path, root, cmd_argv, sync_pipe[0]);
+    close(sync_pipe[0]);
+    if (new_pid < 0) {
+        fprintf(stderr, "Warning: could not join the pinned namespaces of %s; starting it cold.\n", pid_str);
+        close(sync_pipe[1]);
+        return -1;
+    }
+
+    char new_state_dir[PATH_MAX], cgroup_path[PATH_MAX];
+    snprintf(new_state_dir, sizeof(new_state_dir), "%s/%ld", MY_RUNTIME_STATE, (long)new_pid);
+    snprintf(cgroup_path, sizeof(cgroup_path), "%s/container_%ld", MY_RUNTIME_CGROUP, (long)new_pid);
+    if (rename(old_state_dir, new_state_dir) != 0) { perror("Failed to rename state directory"); }
+    if (rename(old_cgroup_path, cgroup_path) != 0) { perror("Failed to rename cgroup directory"); }
+
+    if (pin_cpu_flag) {
+        pin_to_next_cpu(new_pid);
+    }
+    if (apply_sched_policy(new_pid, sched_cfg, pin_cpu_flag) != 0) {
+        // The namespaces stay pinned, so the container remains warm-stopped.
+        fprintf(stderr, "Error: Could not set the scheduling policy; container %s stays stopped.\n", pid_str);
+        kill(new_pid, SIGKILL);
+        waitpid(new_pid, NULL, 0);
+        close(sync_pipe[1]);
+        return 1;
+    }
+
+    if (write(sync_pipe[1], "1", 1) != 1) {
+        perror("write to sync pipe");
+    }
+    close(sync_pipe[1]);
+
+    if (detach_flag) {
+        printf("Container %s started warm with new PID %ld\n", pid_str, (long)new_pid);
+        return 0;
+    }
+    printf("Container %s started warm with new PID %ld. Press Ctrl+C to stop.\n", pid_str, (long)new_pid);
+    waitpid(new_pid, NULL, 0);
+    printf("Container %ld has exited. Use 'rm' to clean up.\n", (long)new_pid);
+    return 0;
+}
+
+
+// ---------- CLI commands -----------
+
+// Long-only options of run.
+enum {
+    OPT_CPU_PERIOD = 1000,
+    OPT_CPU_BURST,
+    OPT_CPU_WEIGHT,
+    OPT_CPU_IDLE,
+    OPT_UCLAMP_MIN,
+    OPT_UCLAMP_MAX,
+    OPT_SCHED_POLICY,
+    OPT_SCHED_PRIORITY,
+    OPT_SCHED_RUNTIME,
+    OPT_SCHED_DEADLINE,
+    OPT_SCHED_PERIOD,
+    OPT_LATENCY_NICE,
+    OPT_EPHEMERAL,
+    OPT_EPHEMERAL_SIZE,
+    OPT_METACOPY,
+    OPT_OVERLAY_INDEX,
+    OPT_SHM_SIZE,
+    OPT_RECORD_PREFETCH,
+    OPT_NO_PREFETCH,
+};
+
+// Removes everything a stopped container owns: mounts, writable layer,
+// image reference, state and cgroup.
+void remove_container(const char *pid_str) {
+    cleanup_mounts(atoi(pid_str));
+    char command[PATH_MAX];
+    char state_dir[PATH_MAX];
+    snprintf(state_dir, sizeof(state_dir), "%s/%s", MY_RUNTIME_STATE, pid_str);
+    char overlay_id_path[PATH_MAX];
+    snprintf(overlay_id_path, sizeof(overlay_id_path), "%s/overlay_id", state_dir);
+    int random_id = -1;
+    FILE* id_file = fopen(overlay_id_path, "r");
+    if (id_file) {
+        fscanf(id_file, "%d", &random_id);
+        fclose(id_file);
+    }
+    if (random_id != -1) {
+        snprintf(command, sizeof(command), "rm -rf overlay_layers/%d", random_id);
+        system(command);
+    }
+    char image_name[PATH_MAX];
+    snprintf(overlay_id_path, sizeof(overlay_id_path), "%s/image_name", state_dir);
+    read_file_string(overlay_id_path, image_name, sizeof(image_name));
+    if (image_name[0] != '\0' && is_image_file(image_name)) {
+        release_image_file(image_name);
+    }
+    snprintf(command, sizeof(command), "rm -rf %s", state_dir);
+    system(command);
+    char cgroup_dir[PATH_MAX];
+    snprintf(cgroup_dir, sizeof(cgroup_dir), "%s/container_%s", MY_RUNTIME_CGROUP, pid_str);
+    if (rmdir(cgroup_dir) != 0) {
+        if (errno != ENOENT) {
+            perror("Failed to remove cgroup directory");
+        }
+    }
+}
+
+int do_run(int argc, char *argv[]) {
+    setup_cgroup_hierarchy();
+    char *mem_limit = NULL;
+    char *cpu_quota = NULL;
+    char *io_read_bps = NULL;
+    char *io_write_bps = NULL;
+    char *propagate_mount_dir = NULL;
+    int pin_cpu_flag = 0;
+    int detach_flag = 0;
+    int share_ipc_flag = 0;
+    char pid_str[16];
+    struct sched_config sched_cfg;
+    memset(&sched_cfg, 0, sizeof(sched_cfg));
+    struct overlay_config overlay_cfg;
+    memset(&overlay_cfg, 0, sizeof(overlay_cfg));
+    char *ephemeral_size = NULL;
+    char *volume_specs[MAX_VOLUMES];
+    int num_volumes = 0;
+    char generated_specs[MAX_VOLUMES][PATH_MAX * 2 + 64];
+    int record_prefetch_seconds = 0;
+    int no_prefetch_flag = 0;
+
+    static struct option long_options[] = {
+            {"mem", required_argument, 0, 'm'},
+            {"cpu", required_argument, 0, 'C'},
+            {"io-read-bps", required_argument, 0, 'r'},
+            {"io-write-bps", required_argument, 0, 'w'},
+            {"pin-cpu", no_argument, NULL, 'p'},
+            {"detach", no_argument, NULL, 'd'},
+            {"share-ipc", no_argument, NULL, 'i'},
+            {"propagate-mount", required_argument, 0, 'M'},
+            {"cpu-period", required_argument, 0, OPT_CPU_PERIOD},
+            {"cpu-burst", required_argument, 0, OPT_CPU_BURST},
+            {"cpu-weight", required_argument, 0, OPT_CPU_WEIGHT},
+            {"cpu-idle", no_argument, NULL, OPT_CPU_IDLE},
+            {"uclamp-min", required_argument, 0, OPT_UCLAMP_MIN},
+            {"uclamp-max", required_argument, 0, OPT_UCLAMP_MAX},
+            {"sched-policy", required_argument, 0, OPT_SCHED_POLICY},
+            {"sched-priority", required_argument, 0, OPT_SCHED_PRIORITY},
+            {"sched-runtime", required_argument, 0, OPT_SCHED_RUNTIME},
+            {"sched-deadline", required_argument, 0, OPT_SCHED_DEADLINE},
+            {"sched-period", required_argument, 0, OPT_SCHED_PERIOD},
+            {"latency-nice", required_argument, 0, OPT_LATENCY_NICE},
+            {"ephemeral", no_argument, NULL, OPT_EPHEMERAL},
+            {"ephemeral-size", required_argument, 0, OPT_EPHEMERAL_SIZE},
+            {"metacopy", no_argument, NULL, OPT_METACOPY},
+            {"overlay-index", no_argument, NULL, OPT_OVERLAY_INDEX},
+            {"volume", required_argument, 0, 'v'},
+            {"shm-size", required_argument, 0, OPT_SHM_SIZE},
+            {"record-prefetch", optional_argument, 0, OPT_RECORD_PREFETCH},
+            {"no-prefetch", no_argument, NULL, OPT_NO_PREFETCH},
+            {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "+m:C:r:w:pdiM:v:", long_options, NULL)) != -1) {
+        if ((opt == 'v' || opt == OPT_SHM_SIZE || opt == 'M') && num_volumes >= MAX_VOLUMES) {
+            fprintf(stderr, "Too many volumes (at most %d)\n", MAX_VOLUMES);
+            return 1;
+        }
+        switch (opt) {
+            case 'm': mem_limit = optarg; break;
+            case 'C': cpu_quota = optarg; break;
+            case 'r': io_read_bps = optarg; break;
+            case 'w': io_write_bps = optarg; break;
+            case 'p': pin_cpu_flag = 1; break;
+            case 'd': detach_flag = 1; break;
+            case 'i': share_ipc_flag = 1; break;
+            case 'M':
+                // Every -M directory must be shared on the host for its
+                // mounts to reach the container's slave copy.
+                if (mount(NULL, optarg, NULL, MS_REC | MS_SHARED, NULL) != 0) {
+                    perror("Failed to set mount propagation to SHARED");
+                    fprintf(stderr, "Hint: Make sure the directory '%s' exists and is a mount point.\n", optarg);
+                    return 1;
+                }
+                propagate_mount_dir = optarg;
+                snprintf(generated_specs[num_volumes], sizeof(generated_specs[num_volumes]),
+                         "type=bind,src=%s,dst=%s,propagation=slave", optarg, optarg);
+                volume_specs[num_volumes] = generated_specs[num_volumes];
+                num_volumes++;
+                break;
+            case 'v': volume_specs[num_volumes++] = optarg; break;
+            case OPT_SHM_SIZE:
+                snprintf(generated_specs[num_volumes], sizeof(generated_specs[num_volumes]),
+                         "type=tmpfs,dst=/dev/shm,size=%s,mode=1777", optarg);
+                volume_specs[num_volumes] = generated_specs[num_volumes];
+                num_volumes++;
+                break;
+            case OPT_CPU_PERIOD: set_sched_field(sched_cfg.cpu_period, optarg); break;
+            case OPT_CPU_BURST: set_sched_field(sched_cfg.cpu_burst, optarg); break;
+            case OPT_CPU_WEIGHT: set_sched_field(sched_cfg.cpu_weight, optarg); break;
+            case OPT_CPU_IDLE: set_sched_field(sched_cfg.cpu_idle, "1"); break;
+            case OPT_UCLAMP_MIN: set_sched_field(sched_cfg.uclamp_min, optarg); break;
+            case OPT_UCLAMP_MAX: set_sched_field(sched_cfg.uclamp_max, optarg); break;
+            case OPT_SCHED_POLICY:
+                if (sched_policy_from_name(optarg) < 0) {
+                    fprintf(stderr, "Unknown scheduling policy '%s' (other, batch, idle, fifo, rr, deadline)\n", optarg);
+                    return 1;
+                }
+                set_sched_field(sched_cfg.policy, optarg);
+                break;
+            case OPT_SCHED_PRIORITY: set_sched_field(sched_cfg.priority, optarg); break;
+            case OPT_SCHED_RUNTIME: set_sched_field(sched_cfg.dl_runtime, optarg); break;
+            case OPT_SCHED_DEADLINE: set_sched_field(sched_cfg.dl_deadline, optarg); break;
+            case OPT_SCHED_PERIOD: set_sched_field(sched_cfg.dl_period, optarg); break;
+            case OPT_LATENCY_NICE: set_sched_field(sched_cfg.latency_nice, optarg); break;
+            case OPT_EPHEMERAL: if (!ephemeral_size) { ephemeral_size = DEFAULT_EPHEMERAL_SIZE; } break;
+            case OPT_EPHEMERAL_SIZE: ephemeral_size = optarg; break;
+            case OPT_METACOPY: overlay_cfg.metacopy = 1; break;
+            case OPT_OVERLAY_INDEX: overlay_cfg.index = 1; break;
+            case OPT_RECORD_PREFETCH:
+                record_prefetch_seconds = optarg ? atoi(optarg) : DEFAULT_PREFETCH_SECONDS;
+                if (record_prefetch_seconds <= 0) {
+                    fprintf(stderr, "Invalid --record-prefetch duration '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_NO_PREFETCH: no_prefetch_flag = 1; break;
+            default: return 1;
+        }
+    }
+    if (optind + 1 >= argc) { fprintf(stderr, "Usage: %s run [opts] <image> <cmd>...\n", argv[0]); return 1; }
+    if (validate_sched_config(&sched_cfg, pin_cpu_flag) != 0) { return 1; }
+    char* image_name = argv[optind];
+    char** container_cmd_argv = &argv[optind + 1];
+
+    struct volume volumes[MAX_VOLUMES];
+    for (int i = 0; i < num_volumes; i++) {
+        if (parse_volume(volume_specs[i], &volumes[i]) != 0) { return 1; }
+    }
+
+    if (ephemeral_size) {
+        snprintf(overlay_cfg.ephemeral_size, sizeof(overlay_cfg.ephemeral_size), "%s", ephemeral_size);
+    }
+
+    char lowerdir[PATH_MAX], merged[PATH_MAX];
+    srand(time(NULL) ^ getpid());
+    char random_id_str[16];
+    if (resolve_lowerdir(image_name, lowerdir, sizeof(lowerdir), 1) != 0) { return 1; }
+    if (reserve_overlay_id(random_id_str, sizeof(random_id_str)) != 0) {
+        if (is_image_file(image_name)) { release_image_file(image_name); }
+        return 1;
+    }
+    if (mount_container_overlay(random_id_str, lowerdir, &overlay_cfg, merged, sizeof(merged)) != 0) {
+        discard_container_overlay(random_id_str);
+        if (is_image_file(image_name)) { release_image_file(image_name); }
+        return 1;
+    }
+
+    // The hints run while the container is being set up. A recording run
+    // skips them, so the profile reflects what the workload actually reads.
+    char profile_path[PATH_MAX];
+    pid_t prefetch_workers[PREFETCH_WORKERS];
+    int num_prefetch_workers = 0;
+    int have_profile_path = prefetch_profile_path(image_name, profile_path, sizeof(profile_path)) == 0;
+    if (have_profile_path && !no_prefetch_flag && record_prefetch_seconds == 0) {
+        num_prefetch_workers = start_prefetch_replay(profile_path, lowerdir, prefetch_workers);
+    }
+
+    int sync_pipe[2];
+    if (pipe(sync_pipe) == -1) {
+        perror("pipe");
+        finish_prefetch_replay(prefetch_workers, num_prefetch_workers);
+        discard_container_overlay(random_id_str);
+        if (is_image_file(image_name)) { release_image_file(image_name); }
+        return 1;
+    }
+
+    struct container_args args;
+    args.merged_path = merged;
+    args.argv = container_cmd_argv;
+    args.volumes = volumes;
+    args.num_volumes = num_volumes;
+    args.sync_pipe_read_fd = sync_pipe[0]; 
+
+    char *container_stack = malloc(STACK_SIZE);
+    char *stack_top = container_stack + STACK_SIZE;
+
+    int clone_flags = CLONE_NEWPID | CLONE_NEWNS | CLONE_NEWUTS | CLONE_NEWUSER | CLONE_NEWNET | SIGCHLD;
+    if (!share_ipc_flag) {
+        clone_flags |= CLONE_NEWIPC;
+    }
+    pid_t container_pid = clone(container_main, stack_top, clone_flags, &args);
+    if (container_pid == -1) {
+        perror("clone");
+        free(container_stack);
+        close(sync_pipe[0]);
+        close(sync_pipe[1]);
+        finish_prefetch_replay(prefetch_workers, num_prefetch_workers);
+        discard_container_overlay(random_id_str);
+        if (is_image_file(image_name)) { release_image_file(image_name); }
+        return 1;
+    }
+
+    close(sync_pipe[0]);
+    
+    char path_buffer[PATH_MAX];
+    uid_t host_uid = getuid();
+    gid_t host_gid = getgid();
+
+    snprintf(path_buffer, sizeof(path_buffer), "/proc/%d/setgroups", container_pid);
+    write_file(path_buffer, "deny");
+
+    snprintf(path_buffer, sizeof(path_buffer), "/proc/%d/gid_map", container_pid);
+    char map_buffer[100];
+    snprintf(map_buffer, sizeof(map_buffer), "0 %d 1", host_gid);
+    write_file(path_buffer, map_buffer);
+
+    snprintf(path_buffer, sizeof(path_buffer), "/proc/%d/uid_map", container_pid);
+    snprintf(map_buffer, sizeof(map_buffer), "0 %d 1", host_uid);
+    write_file(path_buffer, map_buffer);
+
+
+
+    char state_dir[PATH_MAX]; snprintf(state_dir, sizeof(state_dir), "%s/%d", MY_RUNTIME_STATE, container_pid); mkdir(state_dir, 0755);
+    char cgroup_path[PATH_MAX]; snprintf(cgroup_path, sizeof(cgroup_path), "%s/container_%d", MY_RUNTIME_CGROUP, container_pid);
+    if(mkdir(cgroup_path, 0755) != 0 && errno != EEXIST) { perror("Failed to create container cgroup"); }
+
+    snprintf(path_buffer, sizeof(path_buffer), "%s/command", state_dir);
+    FILE *cmd_file = fopen(path_buffer, "w");
+    if (cmd_file) {
+        for (int i = 0; container_cmd_argv[i] != NULL; i++) { fprintf(cmd_file, "%s ", container_cmd_argv[i]); }
+        fclose(cmd_file);
+    }
+
+    snprintf(path_buffer, sizeof(path_buffer), "%s/image_name", state_dir);
+    write_file(path_buffer, image_name);
+
+    snprintf(path_buffer, sizeof(path_buffer), "%s/overlay_id", state_dir);
+    write_file(path_buffer, random_id_str);
+    save_overlay_config(state_dir, &overlay_cfg);
+
+    if (detach_flag) {
+        snprintf(path_buffer, sizeof(path_buffer), "%s/detach", state_dir);
+        write_file(path_buffer, "1");
+    }
+
+    if (share_ipc_flag) {
+        snprintf(path_buffer, sizeof(path_buffer), "%s/share_ipc", state_dir);
+        write_file(path_buffer, "1");
+    }
+
+    if (propagate_mount_dir) {
+        snprintf(path_buffer, sizeof(path_buffer), "%s/propagate_mount_dir", state_dir);
+        write_file(path_buffer, propagate_mount_dir);
+    }
+    save_volumes(state_dir, volume_specs, num_volumes);
+
+    if (no_prefetch_flag) {
+        snprintf(path_buffer, sizeof(path_buffer), "%s/no_prefetch", state_dir);
+        write_file(path_buffer, "1");
+    }
+
+    if (pin_cpu_flag) {
+        snprintf(path_buffer, sizeof(path_buffer), "%s/pin_cpu", state_dir);
+        write_file(path_buffer, "1");
+        pin_to_next_cpu(container_pid);
+    }
+    save_sched_config(state_dir, &sched_cfg);
+    snprintf(pid_str, sizeof(pid_str), "%d", container_pid);
+    if (apply_sched_policy(container_pid, &sched_cfg, pin_cpu_flag) != 0) {
+        // The init is still blocked on the sync pipe; it never runs the command.
+        fprintf(stderr, "Error: Could not set the scheduling policy of container %d.\n", container_pid);
+        kill(container_pid, SIGKILL);
+        waitpid(container_pid, NULL, 0);
+        close(sync_pipe[1]);
+        finish_prefetch_replay(prefetch_workers, num_prefetch_workers);
+        remove_container(pid_str);
+        return 1;
+    }
+    if (mem_limit) {
+        snprintf(path_buffer, sizeof(path_buffer), "%s/mem_limit", state_dir);
+        write_file(path_buffer, mem_limit);
+        snprintf(path_buffer, sizeof(path_buffer), "%s/memory.max", cgroup_path);
+        write_file(path_buffer, mem_limit);
+        snprintf(path_buffer, sizeof(path_buffer), "%s/memory.swap.max", cgroup_path);
+        write_file(path_buffer, "0");
+    }
+    if (cpu_quota) {
+        snprintf(path_buffer, sizeof(path_buffer), "%s/cpu_quota", state_dir);
+        write_file(path_buffer, cpu_quota);
+    }
+    apply_cpu_cgroup(cgroup_path, cpu_quota, &sched_cfg);
+    if (io_read_bps || io_write_bps) {
+        snprintf(path_buffer, sizeof(path_buffer), "%s/io_read_bps", state_dir);
+        write_file(path_buffer, io_read_bps ? io_read_bps : "max");
+        snprintf(path_buffer, sizeof(path_buffer), "%s/io_write_bps", state_dir);
+        write_file(path_buffer, io_write_bps ? io_write_bps : "max");
+        char io_content[128];
+        snprintf(io_content, sizeof(io_content), "8:0 rbps=%s wbps=%s",
+                 io_read_bps ? io_read_bps : "max", io_write_bps ? io_write_bps : "max");
+        snprintf(path_buffer, sizeof(path_buffer), "%s/io.max", cgroup_path);
+        write_file(path_buffer, io_content);
+    }
+
+    char procs_path[PATH_MAX];
+    snprintf(procs_path, sizeof(procs_path), "%s/cgroup.procs", cgroup_path);
+    write_file(procs_path, pid_str);
+
+    int fan_fd = -1;
+    if (record_prefetch_seconds > 0 && have_profile_path) {
+        fan_fd = open_prefetch_recorder(merged);
+    }
+    finish_prefetch_replay(prefetch_workers, num_prefetch_workers);
+
+    // The init only execs once it is in its cgroup with its final policy.
+    if (write(sync_pipe[1], "1", 1) != 1) {
+        perror("write to sync pipe");
+    }
+    close(sync_pipe[1]);
+    if (fan_fd >= 0) {
+        spawn_prefetch_recorder(fan_fd, container_pid, merged, lowerdir, profile_path, record_prefetch_seconds);
+    }
+
+    if (detach_flag) {
+        printf("Container started with PID %d\n", container_pid);
+        return 0;
+    }
+
+    printf("Container started with PID %d. Press Ctrl+C to stop.\n", container_pid);
+    waitpid(container_pid, NULL, 0);
+    printf("Container %d has exited. Use 'rm' to clean up.\n", container_pid);
+    return 0;
+}
+
+
+// Prints the container table; shared by the list command and the API server.
+int list_containers(FILE *out, FILE *err) {
+    DIR *d = opendir(MY_RUNTIME_STATE);
+    if (d == NULL) {
+        if (errno == ENOENT) {
+            fprintf(out, "No containers exist.\n");
+            return 0;
+        }
+        fprintf(err, "opendir: %s\n", strerror(errno));
+        return 1;
+    }
+
+    struct dirent *dir_entry;
+    int found = 0;
+
+    while ((dir_entry = readdir(d)) != NULL) {
+        if (dir_entry->d_type != DT_DIR || strcmp(dir_entry->d_name, ".") == 0 || strcmp(dir_entry->d_name, "..") == 0)
+            continue;
+
+        if (!found) {
+            fprintf(out, "%-15s\t%-10s\t%s\n", "CONTAINER PID", "STATUS", "COMMAND");
+            found = 1;
+        }
+
+        const char* status = process_is_running(dir_entry->d_name) ? "Running" : "Stopped";
+        char state_dir[PATH_MAX];
+        snprintf(state_dir, sizeof(state_dir), "%s/%s", MY_RUNTIME_STATE, dir_entry->d_name);
+        if (status[0] == 'S' && has_pinned_namespaces(state_dir)) status = "Warm";
+
+        char cmd_path[PATH_MAX], cmd_buf[1024] = {0};
+        snprintf(cmd_path, sizeof(cmd_path), "%s/%s/command", MY_RUNTIME_STATE, dir_entry->d_name);
+        FILE *cmd_file = fopen(cmd_path, "r");
+        if (cmd_file) {
+            fgets(cmd_buf, sizeof(cmd_buf) - 1, cmd_file);
+            cmd_buf[strcspn(cmd_buf, "\n")] = 0;
+            fclose(cmd_file);
+        }
+
+        fprintf(out, "%-15s\t%-10s\t%s\n", dir_entry->d_name, status, cmd_buf);
+    }
+
+    closedir(d);
+
+    if (!found) {
+        fprintf(out, "No containers exist.\n");
+    }
+
+    return 0;
+}
+
+int do_list(int argc, char *argv[]) {
+    return list_containers(stdout, stderr);
+}
+
+int do_status(int argc, char *argv[]) {
+    int copy_up_flag = 0;
+    static struct option long_options[] = {
+            {"copy-up", no_argument, 0, 'c'},
+            {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "+c", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'c': copy_up_flag = 1; break;
+            default: return 1;
+        }
+    }
+    if (optind >= argc) { fprintf(stderr, "Usage: %s status [--copy-up] <container_pid>\n", argv[0]); return 1; }
+    char *pid_str = argv[optind];
+    char path_buffer[PATH_MAX], format_buffer[64];
+    char state_dir[PATH_MAX]; snprintf(state_dir, sizeof(state_dir), "%s/%s", MY_RUNTIME_STATE, pid_str);
+    if (access(state_dir, F_OK) != 0) { fprintf(stderr, "Error: No container with PID %s found.\n", pid_str); return 1; }
+    printf("--- Status for Container PID %s ---\n", pid_str);
+    snprintf(path_buffer, sizeof(path_buffer), "%s/command", state_dir);
+    FILE *f = fopen(path_buffer, "r");
+    if (f) {
+        char cmd_buf[1024] = {0}; fgets(cmd_buf, sizeof(cmd_buf)-1, f);
+        cmd_buf[strcspn(cmd_buf, "\n")] = 0; printf("%-25s: %s\n", "Command", cmd_buf); fclose(f);
+    }
+
+    
+    snprintf(path_buffer, sizeof(path_buffer), "%s/propagate_mount_dir", state_dir);
+    f = fopen(path_buffer, "r");
+    if (f) {
+        char p_dir[PATH_MAX] = {0};
+        fgets(p_dir, sizeof(p_dir)-1, f);
+        p_dir[strcspn(p_dir, "\n")] = 0;
+        printf("%-25s: %s\n", "Propagated Mount", p_dir);
+        fclose(f);
+    }
+
+    struct volume volumes[MAX_VOLUMES];
+    int num_volumes = load_volumes(state_dir, volumes, MAX_VOLUMES);
+    for (int i = 0; i < num_volumes; i++) {
+        char volume_desc[PATH_MAX * 2 + 64];
+        if (strcmp(volumes[i].type, "bind") == 0) {
+            snprintf(volume_desc, sizeof(volume_desc), "%s -> %s (bind, %s%s%s)", volumes[i].src, volumes[i].dst,
+                     volumes[i].read_only ? "ro" : "rw", volumes[i].propagation[0] ? ", " : "", volumes[i].propagation);
+        } else {
+            snprintf(volume_desc, sizeof(volume_desc), "%s (tmpfs, %s, size %s)", volumes[i].dst,
+                     volumes[i].read_only ? "ro" : "rw", volumes[i].size[0] ? volumes[i].size : "default");
+        }
+        printf("%-25s: %s\n", "Volume", volume_desc);
+    }
+
+
+    struct overlay_config overlay_cfg;
+    memset(&overlay_cfg, 0, sizeof(overlay_cfg));
+    load_overlay_config(state_dir, &overlay_cfg);
+    char overlay_id[16], image_name[PATH_MAX];
+    snprintf(path_buffer, sizeof(path_buffer), "%s/overlay_id", state_dir);
+    read_file_string(path_buffer, overlay_id, sizeof(overlay_id));
+    snprintf(path_buffer, sizeof(path_buffer), "%s/image_name", state_dir);
+    read_file_string(path_buffer, image_name, sizeof(image_name));
+    char overlay_mode[128];
+    snprintf(overlay_mode, sizeof(overlay_mode), "%s%s%s",
+             overlay_cfg.ephemeral_size[0] != '\0' ? "ephemeral" : "persistent",
+             overlay_cfg.metacopy ? ", metacopy" : "", overlay_cfg.index ? ", index" : "");
+    printf("%-25s: %s\n", "Overlay Mode", overlay_mode);
+    if (overlay_cfg.ephemeral_size[0] != '\0') {
+        printf("%-25s: %s\n", "Ephemeral Layer Size", overlay_cfg.ephemeral_size);
+    }
+    char profile_path[PATH_MAX];
+    long profile_files, profile_bytes;
+    snprintf(path_buffer, sizeof(path_buffer), "%s/no_prefetch", state_dir);
+    if (access(path_buffer, F_OK) == 0) {
+        printf("%-25s: %s\n", "Prefetch Profile", "disabled");
+    } else if (image_name[0] != '\0' && prefetch_profile_path(image_name, profile_path, sizeof(profile_path)) == 0 &&
+               prefetch_profile_summary(profile_path, &profile_files, &profile_bytes) == 0) {
+        format_bytes(profile_bytes, format_buffer, sizeof(format_buffer));
+        printf("%-25s: %ld files, %s\n", "Prefetch Profile", profile_files, format_buffer);
+    }
+    if (has_pinned_namespaces(state_dir)) {
+        printf("%-25s: %s\n", "Warm Start", "ready (namespaces pinned)");
+    }
+
+    // The walk is O(files in the upper layer), so it only runs on request.
+    char lowerdir[PATH_MAX], upperdir[PATH_MAX];
+    if (copy_up_flag && overlay_id[0] != '\0' && image_name[0] != '\0' && lookup_lowerdir(image_name, lowerdir, sizeof(lowerdir)) == 0) {
+        struct copy_up_stats copy_ups;
+        memset(&copy_ups, 0, sizeof(copy_ups));
+        overlay_upper_path(overlay_id, &overlay_cfg, upperdir, sizeof(upperdir));
+        scan_upper_dir(upperdir, lowerdir, lowerdir, &copy_ups);
+        printf("\n--- Copy-up State (snapshot of the upper layer) ---\n");
+        printf("%-25s: %ld\n", "Data Copy-ups", copy_ups.data_copy_ups);
+        format_bytes(copy_ups.copied_bytes, format_buffer, sizeof(format_buffer));
+        printf("%-25s: %s\n", "Copied-up Data", format_buffer);
+        printf("%-25s: %ld\n", "Metadata-only Copy-ups", copy_ups.metadata_copy_ups);
+        printf("%-25s: %ld\n", "New Files", copy_ups.new_files);
+        printf("%-25s: %ld\n", "Renamed Lower Entries", copy_ups.renames);
+        printf("%-25s: %ld\n", "Deleted Lower Files", copy_ups.whiteouts);
+    }
+
+    char cgroup_path[PATH_MAX]; snprintf(cgroup_path, sizeof(cgroup_path), "%s/container_%s", MY_RUNTIME_CGROUP, pid_str);
+    printf("\n--- Resources ---\n");
+    snprintf(path_buffer, sizeof(path_buffer), "%s/memory.current", cgroup_path);
+    long mem_current = read_cgroup_long(path_buffer);
+    format_bytes(mem_current, format_buffer, sizeof(format_buffer));
+    printf("%-25s: %s\n", "Memory Usage", format_buffer);
+    struct memory_sample mem_sample;
+    if (sample_container_memory(cgroup_path, state_dir, &mem_sample) == 0) {
+        format_bytes(mem_sample.working_set, format_buffer, sizeof(format_buffer));
+        printf("%-25s: %s\n", "Est. Working Set", format_buffer);
+        format_bytes(mem_sample.current - mem_sample.working_set, format_buffer, sizeof(format_buffer));
+        printf("%-25s: %s\n", "Reclaimable (est.)", format_buffer);
+    }
+    double mem_pressure = read_memory_pressure(cgroup_path);
+    if (mem_pressure >= 0) { printf("%-25s: %.2f%%\n", "Memory Pressure (10s)", mem_pressure); }
+    snprintf(path_buffer, sizeof(path_buffer), "%s/cpu.stat", cgroup_path);
+    long cpu_micros = find_cgroup_value(path_buffer, "usage_usec");
+    if (cpu_micros >= 0) { printf("%-25s: %.2f seconds\n", "Total CPU Time", (double)cpu_micros / 1000000.0); }
+    snprintf(path_buffer, sizeof(path_buffer), "%s/pids.current", cgroup_path);
+    long pids_current = read_cgroup_long(path_buffer);
+    printf("%-25s: %ld\n", "Active Processes/Threads", pids_current);
+    printf("\n----------------------------------\n");
+    return 0;
+}
+
+int do_freeze(int argc, char *argv[]) {
+    if (argc < 2) { fprintf(stderr, "Usage: %s freeze <container_pid>\n", argv[0]); return 1; }
+    char *pid_str = argv[1]; char freeze_path[PATH_MAX];
+    snprintf(freeze_path, sizeof(freeze_path), "%s/container_%s/cgroup.freeze", MY_RUNTIME_CGROUP, pid_str);
+    write_file(freeze_path, "1"); printf("Froze container %s.\n", pid_str); return 0;
+}
+
+int do_thaw(int argc, char *argv[]) {
+    if (argc < 2) { fprintf(stderr, "Usage: %s thaw <container_pid>\n", argv[0]); return 1; }
+    char *pid_str = argv[1]; char freeze_path[PATH_MAX];
+    snprintf(freeze_path, sizeof(freeze_path), "%s/container_%s/cgroup.freeze", MY_RUNTIME_CGROUP, pid_str);
+    write_file(freeze_path, "0"); printf("Thawed container %s.\n", pid_str); return 0;
+}
+
+int do_stop(int argc, char *argv[]) {
+    int keep_warm_flag = 0;
+    static struct option long_options[] = {
+            {"keep-warm", no_argument, NULL, 'k'},
+            {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "+k", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'k': keep_warm_flag = 1; break;
+            default: return 1;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "Usage: %s stop [--keep-warm] <container_pid>\n", argv[0]);
+        return 1;
+    }
+    pid_t pid = atoi(argv[optind]);
+    if (keep_warm_flag) {
+        return stop_container_warm(pid);
+    }
+    printf("Stopping container %d...\n", pid);
+    if (kill_and_wait(pid) != 0) {
+        perror("kill failed");
+    } else {
+        cleanup_mounts(pid);
+    }
+    printf("Container %d stopped.\n", pid);
+    return 0;
+}
+
+
+
+int do_start(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s start <stopped_container_pid>\n", argv[0]);
+        return 1;
+    }
+    char *pid_str = argv[1];
+    char path_buffer[PATH_MAX];
+
+    if (process_is_running(pid_str)) {
+        fprintf(stderr, "Error: Container %s is already running.\n", pid_str);
+        return 1;
+    }
+
+    char old_state_dir[PATH_MAX];
+    snprintf(old_state_dir, sizeof(old_state_dir), "%s/%s", MY_RUNTIME_STATE, pid_str);
+    if (access(old_state_dir, F_OK) != 0) {
+        fprintf(stderr, "Error: No stopped container with ID %s found.\n", pid_str);
+        return 1;
+    }
+
+    printf("Starting container %s...\n", pid_str);
+    
+    char image_name[PATH_MAX] = {0};
+    char overlay_id[16] = {0};
+    char command_str[1024] = {0};
+    char mem_limit[32] = {0};
+    char cpu_quota[32] = {0};
+    int pin_cpu_flag = 0;
+    int share_ipc_flag = 0;
+    int original_detach_flag = 0;
+    int no_prefetch_flag = 0;
+    char propagate_mount_dir[PATH_MAX] = {0};
+    struct sched_config sched_cfg;
+    memset(&sched_cfg, 0, sizeof(sched_cfg));
+
+    snprintf(path_buffer, sizeof(path_buffer), "%s/image_name", old_state_dir);
+    read_file_string(path_buffer, image_name, sizeof(image_name));
+
+    snprintf(path_buffer, sizeof(path_buffer), "%s/overlay_id", old_state_dir);
+    read_file_string(path_buffer, overlay_id, sizeof(overlay_id));
+    
+    snprintf(path_buffer, sizeof(path_buffer), "%s/command", old_state_dir);
+    read_file_string(path_buffer, command_str, sizeof(command_str));
+
+    snprintf(path_buffer, sizeof(path_buffer), "%s/detach", old_state_dir);
+    if (access(path_buffer, F_OK) == 0) {
+        original_detach_flag = 1;
+    }
+
+    snprintf(path_buffer, sizeof(path_buffer), "%s/mem_limit", old_state_dir);
+    read_file_string(path_buffer, mem_limit, sizeof(mem_limit));
+
+    snprintf(path_buffer, sizeof(path_buffer), "%s/cpu_quota", old_state_dir);
+    read_file_string(path_buffer, cpu_quota, sizeof(cpu_quota));
+
+    snprintf(path_buffer, sizeof(path_buffer), "%s/pin_cpu", old_state_dir);
+    if (access(path_buffer, F_OK) == 0) { pin_cpu_flag = 1; }
+
+    snprintf(path_buffer, sizeof(path_buffer), "%s/share_ipc", old_state_dir);
+    if (access(path_buffer, F_OK) == 0) { share_ipc_flag = 1; }
+
+    snprintf(path_buffer, sizeof(path_buffer), "%s/no_prefetch", old_state_dir);
+    if (access(path_buffer, F_OK) == 0) { no_prefetch_flag = 1; }
+    
+    snprintf(path_buffer, sizeof(path_buffer), "%s/propagate_mount_dir", old_state_dir);
+    read_file_string(path_buffer, propagate_mount_dir, sizeof(propagate_mount_dir));
+
+    struct volume volumes[MAX_VOLUMES];
+    int num_volumes = load_volumes(old_state_dir, volumes, MAX_VOLUMES);
+    snprintf(path_buffer, sizeof(path_buffer), "%s/volumes", old_state_dir);
+    if (strlen(propagate_mount_dir) > 0 && access(path_buffer, F_OK) != 0) {
+        // Created before volumes existed: only the propagated mount is known.
+        char propagate_spec[PATH_MAX * 2 + 64];
+        snprintf(propagate_spec, sizeof(propagate_spec), "type=bind,src=%s,dst=%s,propagation=slave",
+                 propagate_mount_dir, propagate_mount_dir);
+        if (parse_volume(propagate_spec, &volumes[0]) == 0) { num_volumes = 1; }
+    }
+
+    load_sched_config(old_state_dir, &sched_cfg);
+    struct overlay_config overlay_cfg;
+    memset(&overlay_cfg, 0, sizeof(overlay_cfg));
+    load_overlay_config(old_state_dir, &overlay_cfg);
+
+    if (strlen(image_name) == 0 || strlen(overlay_id) == 0 || strlen(command_str) == 0) {
+        fprintf(stderr, "Error: Container configuration is corrupt or missing.\n");
+        return 1;
+    }
+    
+    char *argv_for_container[64];
+
+    
+    char temp_command_str[1024];
+    strcpy(temp_command_str, command_str); 
+
+    if (strncmp(temp_command_str, "/bin/sh -c ", 11) == 0) {
+        argv_for_container[0] = "/bin/sh";
+        argv_for_container[1] = "-c";
+        
+        argv_for_container[2] = temp_command_str + 11;
+        argv_for_container[3] = NULL;
+    } else {
+        
+        int i = 0;
+        char *token = strtok(temp_command_str, " \n");
+        while(token != NULL) {
+            argv_for_container[i++] = token;
+            token = strtok(NULL, " \n");
+        }
+        argv_for_container[i] = NULL;
+    }
+
+    if (has_pinned_namespaces(old_state_dir)) {
+        int ret = warm_start_container(pid_str, overlay_id, argv_for_container, original_detach_flag,
+                                       pin_cpu_flag, &sched_cfg);
+        if (ret >= 0) return ret;
+        cleanup_mounts(atoi(pid_str));
+    }
+
+    
+    if (strlen(propagate_mount_dir) > 0) {
+        if (mount(NULL, propagate_mount_dir, NULL, MS_REC | MS_SHARED, NULL) != 0) {
+            perror("Failed to set mount propagation to SHARED");
+            fprintf(stderr, "Hint: Make sure the directory '%s' exists and is a mount point.\n", propagate_mount_dir);
+            return 1;
+        }
+    }
+
+
+    if (strlen(image_name) == 0 || strlen(overlay_id) == 0 || strlen(command_str) == 0) {
+        fprintf(stderr, "Error: Container configuration is corrupt or missing.\n");
+        return 1;
+    }
+
+    char lowerdir[PATH_MAX], merged[PATH_MAX];
+    if (resolve_lowerdir(image_name, lowerdir, sizeof(lowerdir), 0) != 0) { return 1; }
+    if (mount_container_overlay(overlay_id, lowerdir, &overlay_cfg, merged, sizeof(merged)) != 0) {
+        fprintf(stderr, "Error: Could not mount the overlay on start.\n");
+        return 1;
+    }
+
+    char profile_path[PATH_MAX];
+    pid_t prefetch_workers[PREFETCH_WORKERS];
+    int num_prefetch_workers = 0;
+    if (!no_prefetch_flag && prefetch_profile_path(image_name, profile_path, sizeof(profile_path)) == 0) {
+        num_prefetch_workers = start_prefetch_replay(profile_path, lowerdir, prefetch_workers);
+    }
+
+
+    int sync_pipe[2];
+    if (pipe(sync_pipe) == -1) {
+        perror("pipe");
+        return 1;
+    }
+
+    struct container_args args;
+    args.merged_path = merged;
+    args.argv = argv_for_container;
+
+    args.volumes = volumes;
+    args.num_volumes = num_volumes;
+    args.sync_pipe_read_fd = sync_pipe[0];
+
+    char *container_stack = malloc(STACK_SIZE);
+    char *stack_top = container_stack + STACK_SIZE;
+    int clone_flags = CLONE_NEWPID | CLONE_NEWNS | CLONE_NEWUTS | CLONE_NEWNET | SIGCHLD;
+    if (!share_ipc_flag) { 
+        clone_flags |= CLONE_NEWIPC;
+    }
+    pid_t new_pid = clone(container_main, stack_top, clone_flags, &args);
+    if (new_pid == -1) {
+        perror("clone failed on start");
+        free(container_stack);
+        close(sync_pipe[0]);
+        close(sync_pipe[1]);
+        return 1;
+    }
+
+    close(sync_pipe[0]);
+
+    uid_t host_uid;
+    gid_t host_gid;
+    char *sudo_uid_str = getenv("SUDO_UID");
+    char *sudo_gid_str = getenv("SUDO_GID");
+
+    if (sudo_uid_str && sudo_gid_str) {
+        host_uid = atoi(sudo_uid_str);
+        host_gid = atoi(sudo_gid_str);
+    } else {
+        host_uid = getuid();
+        host_gid = getgid();
+    }
+
+    snprintf(path_buffer, sizeof(path_buffer), "/proc/%ld/setgroups", (long)new_pid);
+    write_file(path_buffer, "deny");
+    char map_buffer[100];
+    snprintf(path_buffer, sizeof(path_buffer), "/proc/%ld/gid_map", (long)new_pid);
+    snprintf(map_buffer, sizeof(map_buffer), "0 %d 1", host_gid);
+    write_file(path_buffer, map_buffer);
+    snprintf(path_buffer, sizeof(path_buffer), "/proc/%ld/uid_map", (long)new_pid);
+    snprintf(map_buffer, sizeof(map_buffer), "0 %d 1", host_uid);
+    write_file(path_buffer, map_buffer);
+
+    char new_state_dir[PATH_MAX];
+    snprintf(new_state_dir, sizeof(new_state_dir), "%s/%ld", MY_RUNTIME_STATE, (long)new_pid);
+    rename(old_state_dir, new_state_dir);
+
+    char old_cgroup_path[PATH_MAX];
+    snprintf(old_cgroup_path, sizeof(old_cgroup_path), "%s/container_%s", MY_RUNTIME_CGROUP, pid_str);
+    if (rmdir(old_cgroup_path) != 0) {
+        if (errno != ENOENT) {
+            perror("Failed to remove old cgroup directory");
+        }
+    }
+
+    char cgroup_path[PATH_MAX];
+    snprintf(cgroup_path, sizeof(cgroup_path), "%s/container_%ld", MY_RUNTIME_CGROUP, (long)new_pid);
+    mkdir(cgroup_path, 0755);
+    // The refault baseline belongs to the old cgroup's counters.
+    snprintf(path_buffer, sizeof(path_buffer), "%s/reclaim_refaults", new_state_dir);
+    unlink(path_buffer);
+
+    if (pin_cpu_flag) {
+        pin_to_next_cpu(new_pid);
+    }
+    if (apply_sched_policy(new_pid, &sched_cfg, pin_cpu_flag) != 0) {
+        fprintf(stderr, "Error: Could not set the scheduling policy; container %s stays stopped.\n", pid_str);
+        kill(new_pid, SIGKILL);
+        waitpid(new_pid, NULL, 0);
+        close(sync_pipe[1]);
+        finish_prefetch_replay(prefetch_workers, num_prefetch_workers);
+        cleanup_mounts(new_pid);
+        return 1;
+    }
+    if (strlen(mem_limit) > 0) {
+        snprintf(path_buffer, sizeof(path_buffer), "%s/memory.max", cgroup_path);
+        write_file(path_buffer, mem_limit);
+    }
+    apply_cpu_cgroup(cgroup_path, cpu_quota, &sched_cfg);
+
+    char procs_path[PATH_MAX];
+    snprintf(procs_path, sizeof(procs_path), "%s/cgroup.procs", cgroup_path);
+    char new_pid_str[16];
+    snprintf(new_pid_str, sizeof(new_pid_str), "%ld", (long)new_pid);
+    write_file(procs_path, new_pid_str);
+    finish_prefetch_replay(prefetch_workers, num_prefetch_workers);
+
+    if (write(sync_pipe[1], "1", 1) != 1) {
+        perror("write to sync pipe");
+    }
+    close(sync_pipe[1]);
+
+    if (original_detach_flag) {
+        printf("Container %s started with new PID %ld\n", pid_str, (long)new_pid);
+        return 0;
+    } else {
+        printf("Container %s started with new PID %ld. Press Ctrl+C to stop.\n", pid_str, (long)new_pid);
+        waitpid(new_pid, NULL, 0);
+        printf("Container %ld has exited. Use 'rm' to clean up.\n", (long)new_pid);
+    }
+
+    return 0;
+}
+
+
+int do_restart(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s restart <container_pid>\n", argv[0]);
+        return 1;
+    }
+    if (process_is_running(argv[1]) && stop_container_warm(atoi(argv[1])) != 0) {
+        return 1;
+    }
+    return do_start(argc, argv);
+}
+
+
+int do_rm(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s rm <container_pid>\n", argv[0]);
+        return 1;
+    }
+    char *pid_str = argv[1];
+    if (process_is_running(pid_str)) {
+        fprintf(stderr, "Error: Cannot remove a running container. Use 'stop' first.\n");
+        return 1;
+    }
+    printf("Removing container %s...\n", pid_str);
+    remove_container(pid_str);
+    printf("Container %s removed.\n", pid_str);
+    return 0;
+}
+
+
+
+// Probe mode: reads "<container_pid> <cmd> [args...]" lines from stdin and
+// runs up to max_parallel of them at once. Each finished probe prints
+// "<seq> <container_pid> <exit_code> <latency_usec>". Targets stay open for
+// the life of the batch and are reopened if their container restarts.
+struct exec_inflight {
+    pid_t helper;
+    int pidfd;
+    long seq;
+    pid_t container;
+    struct timespec started;
+};
+
+struct exec_batch_state {
+    struct exec_target *targets;
+    size_t num_targets;
+    struct exec_inflight *inflight;
+    int active;
+    long seq, completed, failed, total_usec, max_usec;
+};
+
+struct exec_target *lookup_exec_target(struct exec_batch_state *state, const char *pid_str) {
+    pid_t pid = atoi(pid_str);
+    for (size_t i = 0; i < state->num_targets; i++) {
+        struct exec_target *target = &state->targets[i];
+        if (target->pid != pid) continue;
+        // A container that exited leaves a dead pidfd behind; drop it and
+        // look the container up again.
+        if (syscall(SYS_pidfd_send_signal, target->pidfd, 0, NULL, 0) == 0) return target;
+        close_exec_target(target);
+        *target = state->targets[--state->num_targets];
+        break;
+    }
+    struct exec_target fresh;
+    if (open_exec_target(pid_str, &fresh) != 0) return NULL;
+    state->targets = realloc(state->targets, (state->num_targets + 1) * sizeof(*state->targets));
+    state->targets[state->num_targets] = fresh;
+    return &state->targets[state->num_targets++];
+}
+
+void reap_probe(struct exec_batch_state *state, int index) {
+    struct exec_inflight *slot = &state->inflight[index];
+    int status = 0;
+    waitpid(slot->helper, &status, 0);
+    long usec = elapsed_usec(&slot->started);
+    int code = exit_code_from_status(status);
+    printf("%ld %d %d %ld\n", slot->seq, slot->container, code, usec);
+    state->completed++;
+    if (code != 0) state->failed++;
+    state->total_usec += usec;
+    if (usec > state->max_usec) state->max_usec = usec;
+    if (slot->pidfd >= 0) close(slot->pidfd);
+    *slot = state->inflight[--state->active];
+}
+
+void launch_probe(struct exec_batch_state *state, char *line) {
+    char *cmd_argv[64];
+    int cmd_argc = 0;
+    char *token = strtok(line, " \t");
+    while (token != NULL && cmd_argc < 63) {
+        cmd_argv[cmd_argc++] = token;
+        token = strtok(NULL, " \t");
+    }
+    cmd_argv[cmd_argc] = NULL;
+    if (cmd_argc < 2) return;
+
+    long seq = state->seq++;
+    struct exec_target *target = lookup_exec_target(state, cmd_argv[0]);
+    if (target == NULL) {
+        printf("%ld %s %d %d\n", seq, cmd_argv[0], 126, 0);
+        state->completed++;
+        state->failed++;
+        return;
+    }
+    struct exec_inflight *slot = &state->inflight[state->active];
+    clock_gettime(CLOCK_MONOTONIC, &slot->started);
+    slot->helper = spawn_in_container(target, &cmd_argv[1], 1);
+    if (slot->helper < 0) {
+        perror("fork");
+        printf("%ld %d %d %d\n", seq, target->pid, 126, 0);
+        state->completed++;
+        state->failed++;
+        return;
+    }
+    slot->pidfd = syscall(SYS_pidfd_open, slot->helper, 0);
+    slot->seq = seq;
+    slot->container = target->pid;
+    state->active++;
+    if (slot->pidfd < 0) {
+        // Without a pidfd the poll loop cannot see it exit; wait for it here.
+        perror("pidfd_open");
+        reap_probe(state, state->active - 1);
+    }
+}
+
+int exec_batch(int max_parallel) {
+    struct exec_batch_state state;
+    memset(&state, 0, sizeof(state));
+    state.inflight = calloc(max_parallel, sizeof(*state.inflight));
+    struct pollfd *fds = calloc(max_parallel + 1, sizeof(*fds));
+    char input[65536];
+    size_t input_len = 0;
+    int input_open = 1;
+
+    for (;;) {
+        // Start every complete line we have room for.
+        char *newline;
+        while (state.active < max_parallel && (newline = memchr(input, '\n', input_len)) != NULL) {
+            *newline = '\0';
+            size_t consumed = newline - input + 1;
+            launch_probe(&state, input);
+            memmove(input, input + consumed, input_len - consumed);
+            input_len -= consumed;
+        }
+        fflush(stdout);
+        if (!input_open && state.active == 0) break;
+
+        int nfds = 0;
+        int want_input = input_open && state.active < max_parallel && input_len < sizeof(input) - 1;
+        if (want_input) {
+            fds[nfds].fd = STDIN_FILENO;
+            fds[nfds].events = POLLIN;
+            nfds++;
+        }
+        for (int i = 0; i < state.active; i++) {
+            fds[nfds].fd = state.inflight[i].pidfd;
+            fds[nfds].events = POLLIN;
+            nfds++;
+        }
+        if (nfds == 0) {
+            // A line longer than the buffer: nothing can make progress.
+            fprintf(stderr, "Error: Probe line too long.\n");
+            break;
+        }
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        // A probe's pidfd becomes readable when it exits. Walk backwards,
+        // since reaping moves the last slot into the freed one; the base is
+        // fixed first because reaping changes state.active.
+        int base = nfds - state.active;
+        for (int i = state.active - 1; i >= 0; i--) {
+            if (fds[base + i].revents & POLLIN) reap_probe(&state, i);
+        }
+
+        if (want_input && (fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+            ssize_t n = read(STDIN_FILENO, input + input_len, sizeof(input) - 1 - input_len);
+            if (n > 0) {
+                input_len += n;
+            } else if (n == 0 || errno != EINTR) {
+                input_open = 0;
+                if (input_len > 0 && input[input_len - 1] != '\n') input[input_len++] = '\n';
+            }
+        }
+    }
+
+    if (state.completed > 0) {
+        fprintf(stderr, "%ld execs, %ld failed, mean %ld us, max %ld us\n",
+                state.completed, state.failed, state.total_usec / state.completed, state.max_usec);
+    }
+    for (size_t i = 0; i < state.num_targets; i++) close_exec_target(&state.targets[i]);
+    free(state.targets);
+    free(state.inflight);
+    free(fds);
+    return state.failed > 0 ? 1 : 0;
+}
+
+int do_exec(int argc, char *argv[]) {
+    int batch_flag = 0;
+    int max_parallel = 16;
+    static struct option long_options[] = {
+            {"batch", no_argument, NULL, 'b'},
+            {"parallel", required_argument, 0, 'j'},
+            {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "+bj:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'b': batch_flag = 1; break;
+            case 'j': max_parallel = atoi(optarg); break;
+            default: return 1;
+        }
+    }
+    if (batch_flag) {
+        if (max_parallel < 1) max_parallel = 1;
+        return exec_batch(max_parallel);
+    }
+    if (optind + 1 >= argc) {
+        fprintf(stderr, "Usage: %s exec <container_pid> <cmd> [args...]\n"
+                        "       %s exec --batch [--parallel N] < probes\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    struct exec_target target;
+    if (open_exec_target(argv[optind], &target) != 0) return 1;
+    pid_t helper = spawn_in_container(&target, &argv[optind + 1], 0);
+    close_exec_target(&target);
+    if (helper < 0) { perror("fork"); return 1; }
+    int status;
+    waitpid(helper, &status, 0);
+    return exit_code_from_status(status);
+}
+
+
+
+int reclaim_all_containers(double pressure_limit, int max_step_pct, int dry_run) {
+    DIR *d = opendir(MY_RUNTIME_STATE);
+    if (d == NULL) return 0;
+    struct dirent *dir_entry;
+    while ((dir_entry = readdir(d)) != NULL) {
+        if (dir_entry->d_type != DT_DIR || strcmp(dir_entry->d_name, ".") == 0 || strcmp(dir_entry->d_name, "..") == 0)
+            continue;
+        char proc_path[PATH_MAX];
+        snprintf(proc_path, sizeof(proc_path), "/proc/%s", dir_entry->d_name);
+        if (access(proc_path, F_OK) != 0) continue;
+        reclaim_container(dir_entry->d_name, pressure_limit, max_step_pct, dry_run);
+    }
+    closedir(d);
+    return 0;
+}
+
+int do_reclaim(int argc, char *argv[]) {
+    int all_flag = 0, daemon_flag = 0, dry_run = 0;
+    int interval = 30, max_step_pct = 10;
+    double pressure_limit = 1.0;
+    static struct option long_options[] = {
+            {"all", no_argument, NULL, 'a'},
+            {"daemon", no_argument, NULL, 'D'},
+            {"interval", required_argument, 0, 'n'},
+            {"pressure-limit", required_argument, 0, 'P'},
+            {"max-step", required_argument, 0, 's'},
+            {"dry-run", no_argument, NULL, 'N'},
+            {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "+aDn:P:s:N", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'a': all_flag = 1; break;
+            case 'D': daemon_flag = 1; all_flag = 1; break;
+            case 'n': interval = atoi(optarg); break;
+            case 'P': pressure_limit = atof(optarg); break;
+            case 's': max_step_pct = atoi(optarg); break;
+            case 'N': dry_run = 1; break;
+            default: return 1;
+        }
+    }
+    if (!all_flag && optind >= argc) {
+        fprintf(stderr, "Usage: %s reclaim [--dry-run] [--pressure-limit PCT] [--max-step PCT] <container_pid>...\n"
+                        "       %s reclaim --all | --daemon [--interval SEC]\n", argv[0], argv[0]);
+        return 1;
+    }
+    if (max_step_pct < 1 || max_step_pct > 100) max_step_pct = 10;
+    if (interval < 1) interval = 1;
+
+    if (daemon_flag) {
+        printf("Reclaiming every %d seconds. Press Ctrl+C to stop.\n", interval);
+        for (;;) {
+            reclaim_all_containers(pressure_limit, max_step_pct, dry_run);
+            fflush(stdout);
+            sleep(interval);
+        }
+    }
+    if (all_flag) return reclaim_all_containers(pressure_limit, max_step_pct, dry_run);
+
+    int ret = 0;
+    for (int i = optind; i < argc; i++) {
+        if (reclaim_container(argv[i], pressure_limit, max_step_pct, dry_run) != 0) ret = 1;
+    }
+    return ret;
+}
+
+int do_convert(int argc, char *argv[]) {
+    char *format = "erofs";
+    static struct option long_options[] = {
+            {"format", required_argument, 0, 'f'},
+            {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "+f:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'f': format = optarg; break;
+            default: return 1;
+        }
+    }
+    if (optind + 1 >= argc) {
+        fprintf(stderr, "Usage: %s convert [--format erofs|squashfs] <image_dir> <image_file>\n", argv[0]);
+        return 1;
+    }
+    char *image_dir = argv[optind];
+    char *image_file = argv[optind + 1];
+    struct stat st;
+    if (stat(image_dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "Error: '%s' is not an image directory.\n", image_dir);
+        return 1;
+    }
+
+    // Both formats are LZ4HC compressed: slow to build once, cheap to read.
+    char *erofs_argv[] = { "mkfs.erofs", "-zlz4hc", image_file, image_dir, NULL };
+    char *squashfs_argv[] = { "mksquashfs", image_dir, image_file, "-noappend", "-comp", "lz4", "-Xhc", NULL };
+    char **tool_argv;
+    if (strcmp(format, "erofs") == 0) {
+        tool_argv = erofs_argv;
+    } else if (strcmp(format, "squashfs") == 0) {
+        tool_argv = squashfs_argv;
+    } else {
+        fprintf(stderr, "Unknown image format '%s' (erofs, squashfs)\n", format);
+        return 1;
+    }
+    printf("Converting %s to %s image %s...\n", image_dir, format, image_file);
+    fflush(stdout);
+    // Run the tool directly so paths never pass through a shell.
+    int status = -1;
+    pid_t child = fork();
+    if (child == 0) {
+        execvp(tool_argv[0], tool_argv);
+        perror("execvp");
+        _exit(127);
+    }
+    if (child < 0) perror("fork");
+    else waitpid(child, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Error: Conversion failed. Is %s installed?\n",
+                strcmp(format, "erofs") == 0 ? "erofs-utils" : "squashfs-tools");
+        return 1;
+    }
+    printf("Image %s created.\n", image_file);
+    return 0;
+}
+
+
+
+// Prints a stats line for every container that has a state directory.
+void print_all_container_stats(FILE *out) {
+    DIR *d = opendir(MY_RUNTIME_STATE);
+    if (d == NULL) return;
+    struct dirent *dir_entry;
+    while ((dir_entry = readdir(d)) != NULL) {
+        if (dir_entry->d_type != DT_DIR || strcmp(dir_entry->d_name, ".") == 0 || strcmp(dir_entry->d_name, "..") == 0)
+            continue;
+        print_container_stats(out, dir_entry->d_name, -1);
+    }
+    closedir(d);
+}
+
+int do_stats(int argc, char *argv[]) {
+    printf("%-15s\t%-15s\t%-15s\t%s\n", "CONTAINER PID", "MEMORY_BYTES", "CPU_USEC", "PIDS");
+    if (argc >= 2) {
+        for (int i = 1; i < argc; i++) print_container_stats(stdout, argv[i], -1);
+        return 0;
+    }
+    print_all_container_stats(stdout);
+    return 0;
+}
+
+// ---------- API server -----------
+
+// serve exposes the CLI commands over a unix socket, so an orchestrator pays
+// for neither a fork/exec of my_runner nor sudo per operation.
+//
+// Request:  u32 length, then the command line as NUL-terminated strings,
+//           e.g. "run\0--detach\0ubuntu-base-image\0/bin/sleep\0100\0".
+// Response: u32 length, i32 exit code, then the command's output.
+//
+// One epoll loop serves all connections. list, status, stats, freeze and
+// thaw run in-process; stop signals through a cached pidfd and completes
+// when the pidfd reports the exit. run, start and rm run in a forked worker
+// whose output is collected in a memfd. A connection has at most one request
+// in flight; clients wanting parallelism open more connections.
 
-    snprintf(path_buffer, sizeof(path_buffer), "%s/detach", old_state_dir);
-    if (access(path_buffer, F_OK) == 0) {
-        original_detach_flag = 1;
-    }
+int dispatch_command(int argc, char *argv[]);
 
-    snprintf(path_buffer, sizeof(path_buffer), "%s/mem_limit", old_state_dir);
-    read_file_string(path_buffer, mem_limit, sizeof(mem_limit));
+enum api_event_kind { API_LISTENER, API_CONN, API_WORKER, API_STOP };
 
-    snprintf(path_buffer, sizeof(path_buffer), "%s/cpu_quota", old_state_dir);
-    read_file_string(path_buffer, cpu_quota, sizeof(cpu_quota));
+struct api_event {
+    enum api_event_kind kind;
+    struct api_conn *conn;
+};
 
-    snprintf(path_buffer, sizeof(path_buffer), "%s/pin_cpu", old_state_dir);
-    if (access(path_buffer, F_OK) == 0) { pin_cpu_flag = 1; }
+struct api_conn {
+    int fd;
+    struct api_event conn_ev, worker_ev, stop_ev;
+    char in[API_MAX_FRAME];
+    size_t in_len;
+    char *out;
+    size_t out_len, out_sent;
+    pid_t worker;
+    int worker_pidfd;
+    int worker_output_fd;
+    char target[16];        // container the in-flight request is about
+    pid_t stopping;
+    int stop_pidfd;
+    struct api_conn *prev, *next;
+};
 
-    snprintf(path_buffer, sizeof(path_buffer), "%s/share_ipc", old_state_dir);
-    if (access(path_buffer, F_OK) == 0) { share_ipc_flag = 1; }
-    
-    snprintf(path_buffer, sizeof(path_buffer), "%s/propagate_mount_dir", old_state_dir);
-    read_file_string(path_buffer, propagate_mount_dir, sizeof(propagate_mount_dir));
+// Open handles of one container, reused across requests.
+struct container_handle {
+    pid_t pid;
+    int pidfd;          // -1 while the container is stopped
+    int cgroup_fd;
+};
 
-    if (strlen(image_name) == 0 || strlen(overlay_id) == 0 || strlen(command_str) == 0) {
-        fprintf(stderr, "Error: Container configuration is corrupt or missing.\n");
-        return 1;
+struct api_server {
+    int epoll_fd;
+    int listen_fd;
+    int devnull_fd;
+    struct container_handle *handles;
+    size_t num_handles;
+    struct api_conn *conns;
+};
+
+// A handle goes stale once its container exits (its PID may then be reused)
+// or its cgroup is removed by a CLI stop, start or rm behind our back.
+int container_handle_is_valid(const struct container_handle *handle) {
+    if (handle->pidfd >= 0 && syscall(SYS_pidfd_send_signal, handle->pidfd, 0, NULL, 0) != 0) return 0;
+    char path_buffer[PATH_MAX];
+    struct stat path_st, fd_st;
+    snprintf(path_buffer, sizeof(path_buffer), "%s/container_%d", MY_RUNTIME_CGROUP, handle->pid);
+    if (stat(path_buffer, &path_st) != 0 || fstat(handle->cgroup_fd, &fd_st) != 0) return 0;
+    return path_st.st_dev == fd_st.st_dev && path_st.st_ino == fd_st.st_ino;
+}
+
+// Closes the fds of every handle that went stale.
+void prune_container_handles(struct api_server *server) {
+    for (size_t i = 0; i < server->num_handles; ) {
+        if (container_handle_is_valid(&server->handles[i])) { i++; continue; }
+        if (server->handles[i].pidfd >= 0) close(server->handles[i].pidfd);
+        close(server->handles[i].cgroup_fd);
+        server->handles[i] = server->handles[--server->num_handles];
     }
+}
 
-    
-    if (strlen(propagate_mount_dir) > 0) {
-        if (mount(NULL, propagate_mount_dir, NULL, MS_REC | MS_SHARED, NULL) != 0) {
-            perror("Failed to set mount propagation to SHARED");
-            fprintf(stderr, "Hint: Make sure the directory '%s' exists and is a mount point.\n", propagate_mount_dir);
-            return 1;
-        }
+struct container_handle *get_container_handle(struct api_server *server, const char *pid_str) {
+    pid_t pid = atoi(pid_str);
+    prune_container_handles(server);
+    for (size_t i = 0; i < server->num_handles; i++) {
+        if (server->handles[i].pid == pid) return &server->handles[i];
     }
+    char path_buffer[PATH_MAX];
+    snprintf(path_buffer, sizeof(path_buffer), "%s/container_%s", MY_RUNTIME_CGROUP, pid_str);
+    int cgroup_fd = open(path_buffer, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (pid <= 0 || cgroup_fd < 0) return NULL;
+    server->handles = realloc(server->handles, (server->num_handles + 1) * sizeof(*server->handles));
+    struct container_handle *handle = &server->handles[server->num_handles++];
+    handle->pid = pid;
+    handle->cgroup_fd = cgroup_fd;
+    handle->pidfd = syscall(SYS_pidfd_open, pid, 0);
+    return handle;
+}
 
+void drop_container_handle(struct api_server *server, const char *pid_str) {
+    pid_t pid = atoi(pid_str);
+    for (size_t i = 0; i < server->num_handles; i++) {
+        if (server->handles[i].pid != pid) continue;
+        if (server->handles[i].pidfd >= 0) close(server->handles[i].pidfd);
+        close(server->handles[i].cgroup_fd);
+        server->handles[i] = server->handles[--server->num_handles];
+        return;
+    }
+}
 
-    if (strlen(image_name) == 0 || strlen(overlay_id) == 0 || strlen(command_str) == 0) {
-        fprintf(stderr, "Error: Container configuration is corrupt or missing.\n");
-        return 1;
+void api_respond(struct api_server *server, struct api_conn *conn, int code, const char *output, size_t len) {
+    // Clients refuse frames above API_MAX_FRAME, the same limit as requests.
+    const char *truncated = "\n[output truncated]\n";
+    size_t max_len = API_MAX_FRAME - sizeof(int32_t), kept = len;
+    if (len > max_len) { kept = max_len - strlen(truncated); len = max_len; }
+    uint32_t frame_len = sizeof(int32_t) + len;
+    int32_t exit_code = code;
+    conn->out = malloc(sizeof(frame_len) + frame_len);
+    memcpy(conn->out, &frame_len, sizeof(frame_len));
+    memcpy(conn->out + sizeof(frame_len), &exit_code, sizeof(exit_code));
+    if (kept > 0) memcpy(conn->out + sizeof(frame_len) + sizeof(exit_code), output, kept);
+    if (kept < len) memcpy(conn->out + sizeof(frame_len) + sizeof(exit_code) + kept, truncated, len - kept);
+    conn->out_len = sizeof(frame_len) + frame_len;
+    conn->out_sent = 0;
+    struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = &conn->conn_ev };
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+void api_close(struct api_server *server, struct api_conn *conn) {
+    if (conn->fd >= 0) {
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+        close(conn->fd);
     }
+    // A worker or stop still in flight keeps the connection alive until it
+    // completes; its response is then dropped.
+    if (conn->worker > 0 || conn->stopping > 0) {
+        conn->fd = -1;
+        return;
+    }
+    if (conn->prev) conn->prev->next = conn->next;
+    else server->conns = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+    free(conn->out);
+    free(conn);
+}
 
-    char lowerdir[PATH_MAX], upperdir[PATH_MAX], workdir[PATH_MAX], merged[PATH_MAX];
-    snprintf(lowerdir, sizeof(lowerdir), "%s", image_name);
-    snprintf(upperdir, sizeof(upperdir), "overlay_layers/%s/upper", overlay_id);
-    snprintf(workdir, sizeof(workdir), "overlay_layers/%s/work", overlay_id);
-    snprintf(merged, sizeof(merged), "overlay_layers/%s/merged", overlay_id);
+int api_freeze(struct api_server *server, const char *pid_str, const char *value, char **output, size_t *len) {
+    struct container_handle *handle = get_container_handle(server, pid_str);
+    FILE *mem = open_memstream(output, len);
+    int code = 0;
+    int fd = handle ? openat(handle->cgroup_fd, "cgroup.freeze", O_WRONLY | O_CLOEXEC) : -1;
+    if (fd < 0 || write(fd, value, 1) != 1) {
+        fprintf(mem, "Error: Could not %s container %s.\n", value[0] == '1' ? "freeze" : "thaw", pid_str);
+        code = 1;
+    } else {
+        fprintf(mem, "%s container %s.\n", value[0] == '1' ? "Froze" : "Thawed", pid_str);
+    }
+    if (fd >= 0) close(fd);
+    fclose(mem);
+    return code;
+}
 
-    char mount_opts[PATH_MAX * 3];
-    snprintf(mount_opts, sizeof(mount_opts), "lowerdir=%s,upperdir=%s,workdir=%s", lowerdir, upperdir, workdir);
-    if (mount("overlay", merged, "overlay", 0, mount_opts) != 0) {
-        perror("Overlay mount failed on start");
-        return 1;
+int api_list(char **output, size_t *len) {
+    FILE *mem = open_memstream(output, len);
+    int code = list_containers(mem, mem);
+    fclose(mem);
+    return code;
+}
+
+int api_stats(struct api_server *server, int argc, char *argv[], char **output, size_t *len) {
+    FILE *mem = open_memstream(output, len);
+    fprintf(mem, "%-15s\t%-15s\t%-15s\t%s\n", "CONTAINER PID", "MEMORY_BYTES", "CPU_USEC", "PIDS");
+    if (argc < 2) print_all_container_stats(mem);
+    for (int i = 1; i < argc; i++) {
+        struct container_handle *handle = get_container_handle(server, argv[i]);
+        print_container_stats(mem, argv[i], handle ? handle->cgroup_fd : -1);
     }
+    fclose(mem);
+    return 0;
+}
 
-    
-    char *argv_for_container[64];
+// Starts an asynchronous stop. Returns -1 if the caller should fall back to
+// the plain stop command (e.g. the container is not running).
+int api_start_stop(struct api_server *server, struct api_conn *conn, const char *pid_str) {
+    struct container_handle *handle = get_container_handle(server, pid_str);
+    if (handle == NULL || handle->pidfd < 0) return -1;
+    if (syscall(SYS_pidfd_send_signal, handle->pidfd, SIGKILL, NULL, 0) != 0) return -1;
+    conn->stopping = handle->pid;
+    conn->stop_pidfd = dup(handle->pidfd);
+    drop_container_handle(server, pid_str);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &conn->stop_ev };
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, conn->stop_pidfd, &ev);
+    return 0;
+}
 
-    
-    char temp_command_str[1024];
-    strcpy(temp_command_str, command_str); 
+void api_finish_stop(struct api_server *server, struct api_conn *conn) {
+    char output[128];
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, conn->stop_pidfd, NULL);
+    close(conn->stop_pidfd);
+    waitpid(conn->stopping, NULL, WNOHANG);
+    cleanup_mounts(conn->stopping);
+    int len = snprintf(output, sizeof(output), "Stopping container %d...\nContainer %d stopped.\n",
+                       conn->stopping, conn->stopping);
+    conn->stopping = 0;
+    if (conn->fd < 0) { api_close(server, conn); return; }
+    api_respond(server, conn, 0, output, len);
+}
 
-    if (strncmp(temp_command_str, "/bin/sh -c ", 11) == 0) {
-        argv_for_container[0] = "/bin/sh";
-        argv_for_container[1] = "-c";
-        
-        argv_for_container[2] = temp_command_str + 11;
-        argv_for_container[3] = NULL;
-    } else {
-        
-        int i = 0;
-        char *token = strtok(temp_command_str, " \n");
-        while(token != NULL) {
-            argv_for_container[i++] = token;
-            token = strtok(NULL, " \n");
+// Closes the server's own fds in a freshly forked worker, so a long run or
+// stop cannot keep the listener, other clients or container handles alive.
+void api_close_server_fds(struct api_server *server) {
+    close(server->listen_fd);
+    close(server->epoll_fd);
+    for (struct api_conn *c = server->conns; c; c = c->next) {
+        if (c->fd >= 0) close(c->fd);
+        if (c->worker > 0) {
+            close(c->worker_pidfd);
+            close(c->worker_output_fd);
         }
-        argv_for_container[i] = NULL;
+        if (c->stopping > 0) close(c->stop_pidfd);
+    }
+    for (size_t i = 0; i < server->num_handles; i++) {
+        if (server->handles[i].pidfd >= 0) close(server->handles[i].pidfd);
+        close(server->handles[i].cgroup_fd);
     }
+}
 
-    int sync_pipe[2];
-    if (pipe(sync_pipe) == -1) {
-        perror("pipe");
-        return 1;
+void api_start_worker(struct api_server *server, struct api_conn *conn, int argc, char *argv[]) {
+    int output_fd = memfd_create("my_runner-api", MFD_CLOEXEC);
+    pid_t worker = output_fd >= 0 ? fork() : -1;
+    if (worker == 0) {
+        dup2(output_fd, STDOUT_FILENO);
+        dup2(output_fd, STDERR_FILENO);
+        close(output_fd);
+        api_close_server_fds(server);
+        // Containers started for an API client must not keep the memfd.
+        container_stdio_fd = server->devnull_fd;
+        optind = 0;
+        int code = dispatch_command(argc, argv);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(code & 0xff);
+    }
+    if (worker < 0) {
+        const char *msg = "Error: Could not start a worker.\n";
+        if (output_fd >= 0) close(output_fd);
+        api_respond(server, conn, 1, msg, strlen(msg));
+        return;
     }
+    conn->worker = worker;
+    conn->worker_output_fd = output_fd;
+    conn->worker_pidfd = syscall(SYS_pidfd_open, worker, 0);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &conn->worker_ev };
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, conn->worker_pidfd, &ev);
+}
 
-    struct container_args args;
-    args.merged_path = merged;
-    args.argv = argv_for_container;
+void api_finish_worker(struct api_server *server, struct api_conn *conn) {
+    int status = 0;
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, conn->worker_pidfd, NULL);
+    close(conn->worker_pidfd);
+    waitpid(conn->worker, &status, 0);
+    conn->worker = 0;
+
+    struct stat st;
+    char *output = NULL;
+    size_t len = 0;
+    if (fstat(conn->worker_output_fd, &st) == 0 && st.st_size > 0) {
+        output = malloc(st.st_size);
+        ssize_t n = pread(conn->worker_output_fd, output, st.st_size, 0);
+        len = n > 0 ? n : 0;
+    }
+    close(conn->worker_output_fd);
+    // The container behind this request changed PID or went away.
+    if (conn->target[0] != '\0') drop_container_handle(server, conn->target);
 
-    args.propagate_mount_dir = strlen(propagate_mount_dir) > 0 ? propagate_mount_dir : NULL; 
-    args.sync_pipe_read_fd = sync_pipe[0];
+    if (conn->fd < 0) {
+        free(output);
+        api_close(server, conn);
+        return;
+    }
+    api_respond(server, conn, WIFEXITED(status) ? WEXITSTATUS(status) : 1, output, len);
+    free(output);
+}
 
-    char *container_stack = malloc(STACK_SIZE);
-    char *stack_top = container_stack + STACK_SIZE;
-    int clone_flags = CLONE_NEWPID | CLONE_NEWNS | CLONE_NEWUTS | CLONE_NEWNET | SIGCHLD;
-    if (!share_ipc_flag) { 
-        clone_flags |= CLONE_NEWIPC;
+void api_handle_request(struct api_server *server, struct api_conn *conn, char *payload, size_t size) {
+    char *argv[API_MAX_ARGS + 1];
+    int argc = 0;
+    for (size_t pos = 0; pos < size && argc < API_MAX_ARGS; ) {
+        argv[argc++] = payload + pos;
+        pos += strnlen(payload + pos, size - pos) + 1;
     }
-    pid_t new_pid = clone(container_main, stack_top, clone_flags, &args);
-    if (new_pid == -1) {
-        perror("clone failed on start");
-        free(container_stack);
-        close(sync_pipe[0]);
-        close(sync_pipe[1]);
-        return 1;
+    argv[argc] = NULL;
+    char *output = NULL;
+    size_t len = 0;
+    int code;
+
+    conn->target[0] = '\0';
+    if (argc == 0) {
+        const char *msg = "Error: Empty request.\n";
+        api_respond(server, conn, 1, msg, strlen(msg));
+        return;
+    }
+    // Only these change a container's PID or remove it; run creates a new one.
+    if (argc >= 2 && (strcmp(argv[0], "start") == 0 || strcmp(argv[0], "stop") == 0 ||
+                      strcmp(argv[0], "rm") == 0 || strcmp(argv[0], "restart") == 0)) {
+        snprintf(conn->target, sizeof(conn->target), "%s", argv[argc - 1]);
     }
 
-    close(sync_pipe[0]);
+    if (strcmp(argv[0], "list") == 0) {
+        code = api_list(&output, &len);
+    } else if (strcmp(argv[0], "stats") == 0) {
+        code = api_stats(server, argc, argv, &output, &len);
+    } else if ((strcmp(argv[0], "freeze") == 0 || strcmp(argv[0], "thaw") == 0) && argc >= 2) {
+        code = api_freeze(server, argv[1], strcmp(argv[0], "freeze") == 0 ? "1" : "0", &output, &len);
+    } else if (strcmp(argv[0], "stop") == 0 && argc == 2 && api_start_stop(server, conn, argv[1]) == 0) {
+        return;
+    } else if (strcmp(argv[0], "run") == 0 || strcmp(argv[0], "start") == 0 || strcmp(argv[0], "rm") == 0 ||
+               strcmp(argv[0], "stop") == 0 || strcmp(argv[0], "restart") == 0 || strcmp(argv[0], "status") == 0) {
+        // status walks the upper layer with --copy-up, so it must not block the loop.
+        api_start_worker(server, conn, argc, argv);
+        return;
+    } else {
+        char msg[128];
+        int n = snprintf(msg, sizeof(msg), "Error: Command '%s' is not available over the API.\n", argv[0]);
+        api_respond(server, conn, 1, msg, n);
+        return;
+    }
+    api_respond(server, conn, code, output, len);
+    free(output);
+}
 
-    uid_t host_uid;
-    gid_t host_gid;
-    char *sudo_uid_str = getenv("SUDO_UID");
-    char *sudo_gid_str = getenv("SUDO_GID");
+void api_on_readable(struct api_server *server, struct api_conn *conn) {
+    ssize_t n = read(conn->fd, conn->in + conn->in_len, sizeof(conn->in) - conn->in_len);
+    if (n <= 0) {
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+        api_close(server, conn);
+        return;
+    }
+    conn->in_len += n;
+    uint32_t frame_len;
+    if (conn->in_len < sizeof(frame_len)) return;
+    memcpy(&frame_len, conn->in, sizeof(frame_len));
+    if (frame_len > sizeof(conn->in) - sizeof(frame_len)) {
+        api_close(server, conn);
+        return;
+    }
+    if (conn->in_len < sizeof(frame_len) + frame_len) return;
+
+    // Stop reading until this request has been answered.
+    struct epoll_event ev = { .events = 0, .data.ptr = &conn->conn_ev };
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+    char payload[API_MAX_FRAME];
+    memcpy(payload, conn->in + sizeof(frame_len), frame_len);
+    conn->in_len -= sizeof(frame_len) + frame_len;
+    memmove(conn->in, conn->in + sizeof(frame_len) + frame_len, conn->in_len);
+    api_handle_request(server, conn, payload, frame_len);
+}
 
-    if (sudo_uid_str && sudo_gid_str) {
-        host_uid = atoi(sudo_uid_str);
-        host_gid = atoi(sudo_gid_str);
-    } else {
-        host_uid = getuid();
-        host_gid = getgid();
+void api_on_writable(struct api_server *server, struct api_conn *conn) {
+    ssize_t n = send(conn->fd, conn->out + conn->out_sent, conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EINTR) api_close(server, conn);
+        return;
     }
+    conn->out_sent += n;
+    if (conn->out_sent < conn->out_len) return;
+    free(conn->out);
+    conn->out = NULL;
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &conn->conn_ev };
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+    // A pipelined request may already be buffered.
+    if (conn->in_len > 0) api_on_readable(server, conn);
+}
 
-    snprintf(path_buffer, sizeof(path_buffer), "/proc/%ld/setgroups", (long)new_pid);
-    write_file(path_buffer, "deny");
-    char map_buffer[100];
-    snprintf(path_buffer, sizeof(path_buffer), "/proc/%ld/gid_map", (long)new_pid);
-    snprintf(map_buffer, sizeof(map_buffer), "0 %d 1", host_gid);
-    write_file(path_buffer, map_buffer);
-    snprintf(path_buffer, sizeof(path_buffer), "/proc/%ld/uid_map", (long)new_pid);
-    snprintf(map_buffer, sizeof(map_buffer), "0 %d 1", host_uid);
-    write_file(path_buffer, map_buffer);
-    
-    if (write(sync_pipe[1], "1", 1) != 1) {
-        perror("write to sync pipe");
+void api_accept(struct api_server *server) {
+    int fd;
+    while ((fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        struct api_conn *conn = calloc(1, sizeof(*conn));
+        conn->fd = fd;
+        conn->conn_ev = (struct api_event){ API_CONN, conn };
+        conn->worker_ev = (struct api_event){ API_WORKER, conn };
+        conn->stop_ev = (struct api_event){ API_STOP, conn };
+        conn->next = server->conns;
+        if (server->conns) server->conns->prev = conn;
+        server->conns = conn;
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &conn->conn_ev };
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
     }
-    
-    char new_state_dir[PATH_MAX];
-    snprintf(new_state_dir, sizeof(new_state_dir), "%s/%ld", MY_RUNTIME_STATE, (long)new_pid);
-    rename(old_state_dir, new_state_dir);
+}
 
-    char old_cgroup_path[PATH_MAX];
-    snprintf(old_cgroup_path, sizeof(old_cgroup_path), "%s/container_%s", MY_RUNTIME_CGROUP, pid_str);
-    if (rmdir(old_cgroup_path) != 0) {
-        if (errno != ENOENT) {
-            perror("Failed to remove old cgroup directory");
+int do_serve(int argc, char *argv[]) {
+    char *socket_path = API_SOCKET;
+    static struct option long_options[] = {
+            {"socket", required_argument, 0, 'S'},
+            {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "+S:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'S': socket_path = optarg; break;
+            default: return 1;
         }
     }
+    setup_cgroup_hierarchy();
 
-    char cgroup_path[PATH_MAX];
-    snprintf(cgroup_path, sizeof(cgroup_path), "%s/container_%ld", MY_RUNTIME_CGROUP, (long)new_pid);
-    mkdir(cgroup_path, 0755);
-
-    if (pin_cpu_flag) {
-        FILE *f_cpu = fopen(NEXT_CPU_FILE, "r+");
-        int next_cpu = 0;
-        if (f_cpu) { fscanf(f_cpu, "%d", &next_cpu); }
-        else { f_cpu = fopen(NEXT_CPU_FILE, "w"); }
-        long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
-        int target_cpu = next_cpu % num_cpus;
-        cpu_set_t cpuset;
-        CPU_ZERO(&cpuset);
-        CPU_SET(target_cpu, &cpuset);
-        if (sched_setaffinity(new_pid, sizeof(cpu_set_t), &cpuset) != 0) {
-            perror("sched_setaffinity failed");
+    struct api_server server;
+    memset(&server, 0, sizeof(server));
+    server.devnull_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    server.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+    unlink(socket_path);
+    // Only root may drive the runtime, exactly as with sudo ./my_runner.
+    mode_t old_umask = umask(0077);
+    if (bind(server.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server.listen_fd, 128) != 0) {
+        perror("Failed to listen on API socket");
+        return 1;
+    }
+    umask(old_umask);
+
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct api_event listener_ev = { API_LISTENER, NULL };
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &listener_ev };
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &ev);
+    printf("Serving the API on %s. Press Ctrl+C to stop.\n", socket_path);
+    fflush(stdout);
+
+    struct epoll_event events[64];
+    for (;;) {
+        int n = epoll_wait(server.epoll_fd, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
             return 1;
         }
-        struct sched_param param = { .sched_priority = 50 };
-        if (sched_setscheduler(new_pid, SCHED_RR, &param) != 0) {
-            perror("sched_setscheduler failed");
-            return 1;
+        for (int i = 0; i < n; i++) {
+            struct api_event *event = events[i].data.ptr;
+            struct api_conn *conn = event->conn;
+            switch (event->kind) {
+                case API_LISTENER: api_accept(&server); break;
+                case API_WORKER: api_finish_worker(&server, conn); break;
+                case API_STOP: api_finish_stop(&server, conn); break;
+                case API_CONN:
+                    if (events[i].events & EPOLLOUT) api_on_writable(&server, conn);
+                    else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) api_on_readable(&server, conn);
+                    break;
+            }
         }
-        fseek(f_cpu, 0, SEEK_SET);
-        fprintf(f_cpu, "%d", (next_cpu + 1) % num_cpus);
-        fclose(f_cpu);
-    }
-    if (strlen(mem_limit) > 0) {
-        snprintf(path_buffer, sizeof(path_buffer), "%s/memory.max", cgroup_path);
-        write_file(path_buffer, mem_limit);
     }
-    if (strlen(cpu_quota) > 0) {
-        char cpu_content[64];
-        snprintf(path_buffer, sizeof(path_buffer), "%s/cpu.max", cgroup_path);
-        snprintf(cpu_content, sizeof(cpu_content), "%s 100000", cpu_quota);
-        write_file(path_buffer, cpu_content);
-    }
-
-    close(sync_pipe[1]);
-
-    char procs_path[PATH_MAX];
-    snprintf(procs_path, sizeof(procs_path), "%s/cgroup.procs", cgroup_path);
-    char new_pid_str[16];
-    snprintf(new_pid_str, sizeof(new_pid_str), "%ld", (long)new_pid);
-    write_file(procs_path, new_pid_str);
+}
 
-    if (original_detach_flag) {
-        printf("Container %s started with new PID %ld\n", pid_str, (long)new_pid);
-        return 0;
-    } else {
-        printf("Container %s started with new PID %ld. Press Ctrl+C to stop.\n", pid_str, (long)new_pid);
-        waitpid(new_pid, NULL, 0);
-        printf("Container %ld has exited. Use 'rm' to clean up.\n", (long)new_pid);
+int read_full(int fd, void *buf, size_t len) {
+    for (size_t got = 0; got < len; ) {
+        ssize_t n = read(fd, (char *)buf + got, len - got);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return -1;
+        }
+        got += n;
     }
-
     return 0;
 }
 
-
-
-int do_rm(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s rm <container_pid>\n", argv[0]);
-        return 1;
+int do_call(int argc, char *argv[]) {
+    char *socket_path = API_SOCKET;
+    static struct option long_options[] = {
+            {"socket", required_argument, 0, 'S'},
+            {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "+S:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'S': socket_path = optarg; break;
+            default: return 1;
+        }
     }
-    char *pid_str = argv[1];
-    char proc_path[PATH_MAX];
-    snprintf(proc_path, sizeof(proc_path), "/proc/%s", pid_str);
-    if (access(proc_path, F_OK) == 0) {
-        fprintf(stderr, "Error: Cannot remove a running container. Use 'stop' first.\n");
+    if (optind >= argc) {
+        fprintf(stderr, "Usage: %s call [--socket PATH] <command> [args...]\n", argv[0]);
         return 1;
     }
-    printf("Removing container %s...\n", pid_str);
-    cleanup_mounts(atoi(pid_str));
-    char command[PATH_MAX];
-    char state_dir[PATH_MAX];
-    snprintf(state_dir, sizeof(state_dir), "%s/%s", MY_RUNTIME_STATE, pid_str);
-    char overlay_id_path[PATH_MAX];
-    snprintf(overlay_id_path, sizeof(overlay_id_path), "%s/overlay_id", state_dir);
-    int random_id = -1;
-    FILE* id_file = fopen(overlay_id_path, "r");
-    if (id_file) {
-        fscanf(id_file, "%d", &random_id);
-        fclose(id_file);
+
+    char request[API_MAX_FRAME];
+    uint32_t frame_len = 0;
+    for (int i = optind; i < argc; i++) {
+        size_t arg_len = strlen(argv[i]) + 1;
+        if (sizeof(frame_len) + frame_len + arg_len > sizeof(request)) {
+            fprintf(stderr, "Error: Request too large.\n");
+            return 1;
+        }
+        memcpy(request + sizeof(frame_len) + frame_len, argv[i], arg_len);
+        frame_len += arg_len;
     }
-    if (random_id != -1) {
-        snprintf(command, sizeof(command), "rm -rf overlay_layers/%d", random_id);
-        system(command);
+    memcpy(request, &frame_len, sizeof(frame_len));
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("Failed to connect to the API socket (is 'serve' running?)");
+        return 1;
     }
-    snprintf(command, sizeof(command), "rm -rf %s", state_dir);
-    system(command);
-    char cgroup_dir[PATH_MAX];
-    snprintf(cgroup_dir, sizeof(cgroup_dir), "%s/container_%s", MY_RUNTIME_CGROUP, pid_str);
-    if (rmdir(cgroup_dir) != 0) {
-        if (errno != ENOENT) {
-            perror("Failed to remove cgroup directory");
-        }
+    size_t total = sizeof(frame_len) + frame_len;
+    for (size_t sent = 0; sent < total; ) {
+        ssize_t n = write(fd, request + sent, total - sent);
+        if (n <= 0) { perror("write request"); return 1; }
+        sent += n;
     }
-    printf("Container %s removed.\n", pid_str);
-    return 0;
+
+    uint32_t response_len;
+    int32_t exit_code;
+    char *output = NULL;
+    if (read_full(fd, &response_len, sizeof(response_len)) != 0 || response_len < sizeof(exit_code) ||
+        response_len > API_MAX_FRAME || read_full(fd, &exit_code, sizeof(exit_code)) != 0 ||
+        (output = malloc(response_len)) == NULL) {
+        fprintf(stderr, "Error: Malformed response from the API server.\n");
+        close(fd);
+        return 1;
+    }
+    size_t output_len = response_len - sizeof(exit_code);
+    if (read_full(fd, output, output_len) == 0) fwrite(output, 1, output_len, stdout);
+    free(output);
+    close(fd);
+    return exit_code;
 }
 
 
 
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <command> [args...]\nCommands: run, list, status, freeze, thaw, stop, start, rm\n", argv[0]);
-        return 1;
-    }
-    if (strcmp(argv[1], "run") == 0) { return do_run(argc - 1, &argv[1]);
-    } else if (strcmp(argv[1], "list") == 0) { return do_list(argc - 1, &argv[1]);
-    } else if (strcmp(argv[1], "status") == 0) { return do_status(argc - 1, &argv[1]);
-    } else if (strcmp(argv[1], "freeze") == 0) { return do_freeze(argc - 1, &argv[1]);
-    } else if (strcmp(argv[1], "thaw") == 0) { return do_thaw(argc - 1, &argv[1]);
-    } else if (strcmp(argv[1], "stop") == 0) { return do_stop(argc - 1, &argv[1]);
-    } else if (strcmp(argv[1], "start") == 0) { return do_start(argc - 1, &argv[1]);
-    } else if (strcmp(argv[1], "rm") == 0) { return do_rm(argc - 1, &argv[1]);
+// argv[0] is the command name, as each do_* function expects.
+int dispatch_command(int argc, char *argv[]) {
+    if (strcmp(argv[0], "run") == 0) { return do_run(argc, argv);
+    } else if (strcmp(argv[0], "list") == 0) { return do_list(argc, argv);
+    } else if (strcmp(argv[0], "status") == 0) { return do_status(argc, argv);
+    } else if (strcmp(argv[0], "stats") == 0) { return do_stats(argc, argv);
+    } else if (strcmp(argv[0], "exec") == 0) { return do_exec(argc, argv);
+    } else if (strcmp(argv[0], "freeze") == 0) { return do_freeze(argc, argv);
+    } else if (strcmp(argv[0], "thaw") == 0) { return do_thaw(argc, argv);
+    } else if (strcmp(argv[0], "stop") == 0) { return do_stop(argc, argv);
+    } else if (strcmp(argv[0], "start") == 0) { return do_start(argc, argv);
+    } else if (strcmp(argv[0], "restart") == 0) { return do_restart(argc, argv);
+    } else if (strcmp(argv[0], "rm") == 0) { return do_rm(argc, argv);
+    } else if (strcmp(argv[0], "reclaim") == 0) { return do_reclaim(argc, argv);
+    } else if (strcmp(argv[0], "convert") == 0) { return do_convert(argc, argv);
+    } else if (strcmp(argv[0], "serve") == 0) { return do_serve(argc, argv);
+    } else if (strcmp(argv[0], "call") == 0) { return do_call(argc, argv);
     } else {
-        fprintf(stderr, "Unknown command: %s\n", argv[1]);
+        fprintf(stderr, "Unknown command: %s\n", argv[0]);
         return 1;
     }
     return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <command> [args...]\nCommands: run, list, status, stats, exec, freeze, thaw, stop, start, restart, rm, reclaim, convert, serve, call\n", argv[0]);
+        return 1;
+    }
+    return dispatch_command(argc - 1, &argv[1]);
 }
\ No newline at end of file